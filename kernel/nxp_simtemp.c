@@ -19,22 +19,85 @@
 #include <linux/kfifo.h>  
 #include <linux/ktime.h>     
 #include <linux/timekeeping.h> 
+#include <linux/kthread.h>
+#include <linux/cpumask.h>
+#include <linux/sched/types.h>
+#include <linux/seqlock.h>
+#include <linux/mutex.h>
+#include <linux/pm_runtime.h>
+#include <linux/minmax.h>
+#include <linux/math64.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/compat.h>
+#include <linux/uio.h>
+#include <linux/eventfd.h>
+#include <linux/list.h>
+#include <linux/mempool.h>
+#include <linux/platform_device.h>
+#include <linux/mod_devicetable.h>
+#include <linux/of.h>
+#include <linux/property.h>
+#include <linux/thermal.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/trigger.h>
+#include <linux/iio/trigger_consumer.h>
+#include <linux/iio/triggered_buffer.h>
+
+#include "nxp_simtemp.h"
+#include "simtemp_core.h"
 
 MODULE_LICENSE("Dual BSD/GPL");
 MODULE_AUTHOR("Eduardo Naranjo Alvarado");
 MODULE_LICENSE("Dual BSD/GPL");
 
 #define DEVICE_NAME "simtemp0"		// Name of file device
+#define AGG_DEVICE_NAME "simtemp0_agg"	// Name of the aggregate stream device
 #define CLASS_NAME  "simtemp"		// Name of class device
 #define MODULE_NAME "nxp_simtemp"	// Name of module device
 
-#define SAMPLE_FIFO_SIZE 1  		// Number of samples stored
+#define SAMPLE_FIFO_SIZE 1  		// Number of samples stored (default fifo_depth)
+#define MAX_FIFO_DEPTH 1024			// Upper bound of fifo_depth (producer passes)
+#define AGG_FIFO_SIZE 16			// Aggregate records stored per channel
+#define SIMTEMP_NR_MINORS 2			// simtemp0 + simtemp0_agg
+#define DEFAULT_HISTORY_LEN 16384	// Records kept in the history ring (384 KiB)
+#define MAX_HISTORY_LEN (1U << 24)	// Upper bound of history_len (384 MiB)
+#define STAGE_RECORDS 64			// Records per staging buffer (one FIFO or history lock hold)
+#define STAGE_POOL_MIN 4			// Staging buffers preallocated per device
+#define READER_POOL_MIN 8			// Reader contexts preallocated per device
+#define CHANNEL_SPREAD_mC 250		// Base temperature offset between channels
+#define BASE_TEMP_mC 25000			// Base simulated temperature
+#define NOISE_SPAN_mC 1000			// Default span of the noisy mode
+#define RAMP_STEP_mC 10				// Ramp increment per sample
+#define SINE_AMPLITUDE_mC 1000		// Amplitude of the sine mode
 #define DEFAULT_SAMPLING_MS 5000	// Default number of sampling
 #define DEFAULT_THRESHOLD_mC 45000	// Default number of threshold
-
-/* flags */
-#define FLAG_NEW_SAMPLE        (1U << 0)	// 0b00000001
-#define FLAG_THRESHOLD_CROSSED (1U << 1)	// 0b00000010
+#define DEFAULT_START_DELAY_MS 5000	// Default delay before the first sample
+#define MIN_SAMPLING_US 100			// Fastest period accepted by the kthread producer (10 kHz)
+#define MAX_SAMPLING_US 10000000	// Slowest period (10 s)
+#define DEFAULT_THERMAL_POLLING_MS 1000	// Thermal core polling of the zone
+
+/* producers */
+#define PRODUCER_WORKQUEUE 0		// Shared workqueue, delayed_work (jiffy resolution)
+#define PRODUCER_KTHREAD   1		// Dedicated kthread, hrtimer absolute deadlines
+
+/* sensor modes (generator modes of simtemp_gen.h) */
+#define MODE_NORMAL SIMTEMP_GEN_NORMAL
+#define MODE_NOISY  SIMTEMP_GEN_NOISY
+#define MODE_RAMP   SIMTEMP_GEN_RAMP
+#define MODE_SINE   SIMTEMP_GEN_SINE
+
+/* re-arm policies when the sampling period changes */
+#define REARM_IMMEDIATE 0			// Sample now, new period counts from here
+#define REARM_ALIGNED   1			// Next sample at last sample + new period
+#define REARM_DEFERRED  2			// Let the pending period elapse first
+
+/* policies when the sample FIFO is full */
+#define OVERFLOW_DROP_NEWEST     0	// Keep the queued records, drop the new ones
+#define OVERFLOW_OVERWRITE_OLDEST 1	// Discard the oldest queued records
+#define OVERFLOW_SLOWDOWN        2	// Drop the new ones and stretch the period
+#define MAX_PERIOD_SHIFT         4	// Slowdown stretches the period up to 16x
 
 /* * Global Variables 
  */
@@ -47,43 +110,190 @@ unsigned int simtemp_minor = 	0;	// Minor number
  * 						STRUCTURES
  * =======================================================
  */
- 
- struct simtemp_sample {
-    __u64 timestamp_ns; // ktime_get_real_ns() 
-    __s32 temp_mC;      // milli-degrees Celsius
-    __u32 flags;        // bit0 NEW_SAMPLE, bit1 THRESHOLD
-} __attribute__((packed));
 
+/*
+ * Configuration read by the producer on every sample. Writers (sysfs) take
+ * cfg_lock as a seqlock; the producer copies a consistent snapshot with
+ * simtemp_config_get() and never blocks on a writer.
+ */
+struct simtemp_config
+{
+	int sampling_ms;	  				// Sample Frequency
+	int sampling_us;					// Sample period in us (used by the kthread producer)
+	int threshold_mc;	  				// Threshold in mc
+	int mode;							// MODE_NORMAL, MODE_NOISY, MODE_RAMP or MODE_SINE
+	int rearm;							// REARM_IMMEDIATE, REARM_ALIGNED or REARM_DEFERRED
+	int agg_samples;					// Close an aggregate window every N samples (0 = off)
+	int agg_window_ms;					// Close an aggregate window every N ms (0 = off)
+	int noise_mc;						// Noise span of the noisy mode
+	int noise_dist;						// SIMTEMP_GEN_DIST_UNIFORM or SIMTEMP_GEN_DIST_GAUSSIAN
+	u32 seed;							// PRNG seed
+	u32 seed_gen;						// Bumped on every seed write, the producer reseeds
+	int overflow;						// OVERFLOW_DROP_NEWEST, OVERFLOW_OVERWRITE_OLDEST or OVERFLOW_SLOWDOWN
+};
+
+/* Per open file state of /dev/simtemp0 and /dev/simtemp0_agg */
+struct simtemp_reader
+{
+	struct simtemp_dev *dev;			// Device opened
+	u64 channel_mask;					// Channels delivered to this file (fifo_lock)
+	u32 format;							// SIMTEMP_RECORD_V1 or SIMTEMP_RECORD_V2
+	u64 lost_seen;						// simtemp_core_lost() of its queue when this file last read
+	bool subscribed;					// Reads its own fifo instead of the shared one (fifo_lock)
+	struct kfifo fifo;					// Own queue of a filtered file, allocated on its first mask
+	struct simtemp_core_drops drops;	// Drop accounting of the own queue (fifo_lock)
+	struct list_head sub_node;			// In dev->subscribers while subscribed
+	u64 alert_seen;						// dev->alert_seq last reported by poll (state_lock)
+	struct eventfd_ctx *alert_ev;		// Signalled on every alert, NULL if unbound (state_lock)
+	struct list_head alert_node;		// In dev->alert_readers while alert_ev is bound
+};
+
+/*
+ * Per device state, allocated on the NUMA node of the producer CPU. Fields
+ * are grouped by who writes them on every sample, each group starting on
+ * its own cacheline, so the producer, the FIFO hand-off and the readers
+ * do not bounce each other's lines.
+ */
 struct simtemp_dev
 {
+	/* Setup and control: init/exit, sysfs, open/release */
 	struct semaphore sem;	  			// Mutual exclusion semaphore
 	struct cdev cdev;	  				// Char device structure
 	struct device *dev;	  				// Device structure /dev
 	int simtemp; 		  				// Sim Temperature
-	int sampling_ms;	  				// Sample Frequency
-	int threshold_mc;	  				// Threshold in mc
-	unsigned long samples_taken;		// Samples taken
-	char sensor_mode[16]; 				// Function mode
-	wait_queue_head_t read_alert_wq;   	// wait queue for readers and alert (poll/wait) 
-    spinlock_t fifo_lock;        		// protects kfifo 
-    struct kfifo fifo;           		// FIFO of samples 
-    bool alert_pending;          		// true if there is a priority event (threshold) 
-    spinlock_t state_lock;       		// protects alert_pending and counters 
-	int count_alerts; 					// Count alerts of threshold
 	struct delayed_work my_work_delay; 	// Work queue
+	int producer;						// PRODUCER_WORKQUEUE or PRODUCER_KTHREAD
+	int rt_priority;					// SCHED_FIFO priority of the kthread (0 = SCHED_NORMAL)
+	int producer_cpu;					// CPU the kthread is pinned to (-1 = any)
+	struct task_struct *producer_task;	// Kthread producer (NULL when not running)
+	bool producer_running;				// Producer started (timer or kthread armed)
+	bool removing;						// simtemp_remove() stopped the producer for good (sem)
+	struct mutex update_lock;			// Serializes simtemp_producer_update()
+	bool producer_wanted;				// Last decision of simtemp_producer_update() (update_lock)
+	bool enabled;						// Sampling enabled from sysfs
+	bool run_on_open;					// Only sample while the device is open
+	int open_count;						// Number of open files
+	struct cdev agg_cdev;				// Char device of the aggregate stream
+	unsigned int channels;				// Channels generated per producer pass
+	struct simtemp_core_hist *history;	// History ring (vmalloc, power of two records)
+	u32 history_mask;					// Ring size - 1
+	struct thermal_zone_device *tz;		// Thermal zone (NULL unless thermal_zone=1)
+	struct thermal_trip trips[1];		// Passive trip at threshold_mc
+	struct iio_dev *iio;				// IIO front end (NULL unless iio=1)
+	struct iio_trigger *iio_trig;		// Trigger fired by the producer on every sample
+	mempool_t *reader_pool;				// struct simtemp_reader of every open file
+	mempool_t *stage_pool;				// STAGE_RECORDS record buffers of read_iter and history
+
+	/* Configuration: read on every pass, written by sysfs only */
+	seqlock_t cfg_lock ____cacheline_aligned_in_smp;	// protects cfg
+	struct simtemp_config cfg;			// Sampling configuration
+
+	/* Producer only */
+	u64 next_seq ____cacheline_aligned_in_smp;	// Sequence number of the next sample
+	unsigned int period_shift;			// Period stretch of the slowdown policy
+	ktime_t kthread_deadline;			// Next absolute wakeup of the kthread (CLOCK_MONOTONIC)
+	struct simtemp_gen_state gen;		// Generator state
+	u32 gen_seed_gen;					// cfg.seed_gen the generator was seeded with
+	struct simtemp_core_agg agg[SIMTEMP_MAX_CHANNELS];	// Window being aggregated, per channel
+	s32 temps[SIMTEMP_MAX_CHANNELS];	// Temperatures of one pass
+	struct simtemp_sample_v2 records[SIMTEMP_MAX_CHANNELS];	// Records of one pass
+	struct simtemp_sample_v2 sub_records[SIMTEMP_MAX_CHANNELS];	// Records of one pass for a filtered file
+
+	/* Producer counters: written every pass, read by stats, poll and ioctl */
+	spinlock_t state_lock ____cacheline_aligned_in_smp;	// protects the fields below
+	u64 alert_seq;						// Alerts raised so far, each file tracks what it has seen
+	struct list_head alert_readers;		// Readers with an alert eventfd bound
+	int count_alerts; 					// Count alerts of threshold
+	unsigned long samples_taken;		// Samples taken
+	ktime_t last_sample_time;			// CLOCK_MONOTONIC time of the last sample
+	unsigned long producer_overruns;	// Periods the kthread producer missed and skipped
+	ktime_t rearm_deadline;				// New deadline requested by a period change
+	bool rearm_pending;					// rearm_deadline not yet picked up by the kthread
+
+	/* History ring: appended every pass, searched by the history ioctl */
+	spinlock_t history_lock ____cacheline_aligned_in_smp;	// protects the history ring
+	u64 history_head;					// Total records written (next write position)
+
+	/* FIFO hand-off between the producer and the readers */
+    spinlock_t fifo_lock ____cacheline_aligned_in_smp;	// protects the kfifos and their accounting
+    struct kfifo fifo;           		// FIFO of samples (struct simtemp_sample_v2)
+	struct kfifo agg_fifo;				// FIFO of aggregate records
+	struct simtemp_core_drops drops;	// Drop accounting
+	struct list_head subscribers;		// Readers with their own queue (struct simtemp_reader)
+	unsigned long producer_slowdowns;	// Passes that stretched the period
+
+	/* Wait queues: sleeping readers write them, the producer wakes them */
+	wait_queue_head_t read_alert_wq ____cacheline_aligned_in_smp;	// wait queue for readers and alert (poll/wait)
+	wait_queue_head_t agg_wq ____cacheline_aligned_in_smp;	// wait queue for aggregate readers
+
+	/* Latest-value snapshot: written once per pass, read by everyone */
+	seqcount_t latest_seq ____cacheline_aligned_in_smp;	// protects latest, written by the producer only
+	struct simtemp_sample_v2 latest[SIMTEMP_MAX_CHANNELS];	// Newest record of every channel
  };
 
-struct simtemp_dev simtemp_device = {
-	.sampling_ms = DEFAULT_SAMPLING_MS,
-	.threshold_mc = DEFAULT_THRESHOLD_mC,
-	.sensor_mode = "normal",
-}; // Allocate the devices 
-	
+static struct simtemp_dev *simtemp_device;		// Allocated by simtemp_probe()
+static struct platform_device *simtemp_pdev;	// Fallback device without a DT node
+static struct kmem_cache *simtemp_reader_cache;	// Backs the reader pools
+static struct kmem_cache *simtemp_stage_cache;	// Backs the staging pools
 
 static struct class *simtemp_class = NULL;		// Class struct
 static struct device *simtemp_device_f = NULL;	// Device struct
+static struct device *simtemp_agg_device_f = NULL;	// Aggregate device struct
 static struct workqueue_struct *my_workqueue;	// Workqueue struct
 
+static unsigned int start_delay_ms = DEFAULT_START_DELAY_MS;
+module_param(start_delay_ms, uint, 0444);
+MODULE_PARM_DESC(start_delay_ms, "Delay before the first sample after load (ms)");
+
+static bool run_on_open = false;
+module_param(run_on_open, bool, 0444);
+MODULE_PARM_DESC(run_on_open, "Start with the producer running only while the device is open");
+
+static unsigned int history_len = DEFAULT_HISTORY_LEN;
+module_param(history_len, uint, 0444);
+MODULE_PARM_DESC(history_len, "Samples kept in the history ring, rounded up to a power of two (0 = off)");
+
+static unsigned int channels = 1;
+module_param(channels, uint, 0444);
+MODULE_PARM_DESC(channels, "Sensor channels generated per sampling period (1-64)");
+
+static int producer_cpu = -1;
+module_param(producer_cpu, int, 0444);
+MODULE_PARM_DESC(producer_cpu, "CPU of the kthread producer, the device is allocated on its node (-1 = any)");
+
+/* Initial configuration, a DT node's properties take precedence */
+static unsigned int init_sampling_ms = DEFAULT_SAMPLING_MS;
+module_param_named(sampling_ms, init_sampling_ms, uint, 0444);
+MODULE_PARM_DESC(sampling_ms, "Initial sampling period (ms, DT: sampling-ms / sampling-us)");
+
+static int init_threshold_mc = DEFAULT_THRESHOLD_mC;
+module_param_named(threshold_mc, init_threshold_mc, int, 0444);
+MODULE_PARM_DESC(threshold_mc, "Initial alert threshold (mC, DT: threshold-mC)");
+
+static char *init_mode = "normal";
+module_param_named(mode, init_mode, charp, 0444);
+MODULE_PARM_DESC(mode, "Initial sensor mode: normal, noisy, ramp or sine (DT: mode)");
+
+static char *init_producer = "workqueue";
+module_param_named(producer, init_producer, charp, 0444);
+MODULE_PARM_DESC(producer, "Sampling clock: workqueue (jiffies) or kthread (hrtimer) (DT: producer)");
+
+static unsigned int fifo_depth = SAMPLE_FIFO_SIZE;
+module_param(fifo_depth, uint, 0444);
+MODULE_PARM_DESC(fifo_depth, "Producer passes the sample FIFO holds, rounded up to a power of two (DT: fifo-depth)");
+
+static bool thermal_zone = false;
+module_param(thermal_zone, bool, 0444);
+MODULE_PARM_DESC(thermal_zone, "Register the device as a thermal zone (channel 0) (DT: thermal-zone)");
+
+static unsigned int thermal_polling_ms = DEFAULT_THERMAL_POLLING_MS;
+module_param(thermal_polling_ms, uint, 0444);
+MODULE_PARM_DESC(thermal_polling_ms, "Polling period of the thermal zone (ms, 0 = no polling)");
+
+static bool iio = false;
+module_param(iio, bool, 0444);
+MODULE_PARM_DESC(iio, "Also expose channel 0 as an IIO device with a triggered buffer");
+
 
 /*
  * =======================================================
@@ -94,10 +304,22 @@ static struct workqueue_struct *my_workqueue;	// Workqueue struct
 int simtemp_open(struct inode *inode, struct file *filp);
 int simtemp_release(struct inode *inode, struct file *filp);
 unsigned int simtemp_poll(struct file *file, poll_table *wait);
-ssize_t simtemp_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos);
-static void simtemp_setup_cdev(struct simtemp_dev *dev, int index);
+ssize_t simtemp_read_iter(struct kiocb *iocb, struct iov_iter *to);
+long simtemp_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
+int simtemp_agg_open(struct inode *inode, struct file *filp);
+unsigned int simtemp_agg_poll(struct file *file, poll_table *wait);
+ssize_t simtemp_agg_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos);
+static int simtemp_setup_cdev(struct cdev *cdev, struct file_operations *fops, int index);
 static void workqueue_function(struct work_struct *work);
-u32 generate_temperature_sample(struct simtemp_dev *sdev);
+static int kthread_function(void *data);
+static int simtemp_producer_start(struct simtemp_dev *dev, unsigned int delay_ms);
+static void simtemp_producer_stop(struct simtemp_dev *dev);
+static void simtemp_producer_rearm(struct simtemp_dev *dev);
+static void simtemp_producer_update(struct simtemp_dev *dev);
+static void simtemp_iio_poll(struct simtemp_dev *dev);
+static void simtemp_thermal_set_trip(struct simtemp_dev *dev, int temp);
+static void simtemp_thermal_notify(struct simtemp_dev *dev);
+void generate_temperature_batch(struct simtemp_dev *sdev, const struct simtemp_config *cfg, s32 *temps, unsigned int n);
 
 
 /*
@@ -106,15 +328,34 @@ u32 generate_temperature_sample(struct simtemp_dev *sdev);
  * =======================================================
  */
 
+/* Non page cache files splice through read_iter, the helper was renamed in 6.5 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+#define simtemp_splice_read copy_splice_read
+#else
+#define simtemp_splice_read generic_file_splice_read
+#endif
+
 struct file_operations simtemp_fops =
 {
 	.owner = THIS_MODULE,
-	.read = simtemp_read,
+	.read_iter = simtemp_read_iter,
+	.splice_read = simtemp_splice_read,
 	.poll = simtemp_poll,
+	.unlocked_ioctl = simtemp_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
 	.open = simtemp_open,
 	.release = simtemp_release,
 };
 
+struct file_operations simtemp_agg_fops =
+{
+	.owner = THIS_MODULE,
+	.read = simtemp_agg_read,
+	.poll = simtemp_agg_poll,
+	.open = simtemp_agg_open,
+	.release = simtemp_release,
+};
+
 
 /* 
  * =======================================================
@@ -122,402 +363,2518 @@ struct file_operations simtemp_fops =
  * =======================================================
  */
 
-/* * SAMPLING_MS
+static const char * const simtemp_mode_names[] = {
+	[MODE_NORMAL] = "normal",
+	[MODE_NOISY]  = "noisy",
+	[MODE_RAMP]   = "ramp",
+	[MODE_SINE]   = "sine",
+};
+
+/* * CONFIG SNAPSHOT
+ */
+
+/* Copy a consistent view of the configuration, lock-free for the reader */
+static void simtemp_config_get(struct simtemp_dev *sdev, struct simtemp_config *cfg)
+{
+	unsigned int seq;
+
+	do {
+		seq = read_seqbegin(&sdev->cfg_lock);
+		*cfg = sdev->cfg;
+	} while (read_seqretry(&sdev->cfg_lock, seq));
+}
+
+/* * LATEST SAMPLE
+ */
+
+/*
+ * Newest record of a channel without consuming it: a seqcount retry loop,
+ * never blocks and never touches the FIFO. -ENODATA before the first sample
+ */
+static int simtemp_latest_get(struct simtemp_dev *sdev, unsigned int ch, struct simtemp_sample_v2 *rec)
+{
+	unsigned int seq;
+
+	if (ch >= sdev->channels)
+		return -EINVAL;
+
+	do {
+		seq = read_seqcount_begin(&sdev->latest_seq);
+		*rec = sdev->latest[ch];
+	} while (read_seqcount_retry(&sdev->latest_seq, seq));
+
+	return rec->timestamp_ns ? 0 : -ENODATA;
+}
+
+/* Publish the records of one pass, producer only */
+static void simtemp_latest_set(struct simtemp_dev *sdev, const struct simtemp_sample_v2 *rec, unsigned int n)
+{
+	preempt_disable();
+	write_seqcount_begin(&sdev->latest_seq);
+	memcpy(sdev->latest, rec, n * sizeof(*rec));
+	write_seqcount_end(&sdev->latest_seq);
+	preempt_enable();
+}
+
+/* * GENERIC INTEGER ATTRIBUTES
+ */
+
+/* An int field of struct simtemp_config exposed with a valid [min, max] range */
+struct simtemp_cfg_attribute {
+	struct device_attribute attr;
+	size_t offset;
+	int min;
+	int max;
+	void (*changed)(struct simtemp_dev *sdev, int value);	// Called after a store (optional)
+};
+
+#define to_simtemp_cfg_attr(_attr) container_of(_attr, struct simtemp_cfg_attribute, attr)
+
+#define SIMTEMP_CFG_ATTR_INT_CHANGED(_name, _min, _max, _changed)						\
+	static struct simtemp_cfg_attribute dev_attr_##_name = {							\
+		.attr = __ATTR(_name, 0644, simtemp_cfg_int_show, simtemp_cfg_int_store),		\
+		.offset = offsetof(struct simtemp_config, _name),								\
+		.min = _min,																	\
+		.max = _max,																	\
+		.changed = _changed,															\
+	}
+
+#define SIMTEMP_CFG_ATTR_INT(_name, _min, _max)	SIMTEMP_CFG_ATTR_INT_CHANGED(_name, _min, _max, NULL)
+
+static ssize_t simtemp_cfg_int_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	struct simtemp_cfg_attribute *ea = to_simtemp_cfg_attr(attr);
+	struct simtemp_config cfg;
+
+	simtemp_config_get(sdev, &cfg);
+
+	return sprintf(buf, "%d\n", *(int *)((char *)&cfg + ea->offset));
+}
+
+static ssize_t simtemp_cfg_int_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	struct simtemp_cfg_attribute *ea = to_simtemp_cfg_attr(attr);
+	int value = 0;
+
+	if (kstrtoint(buf, 10, &value))	  // Convert from string to int
+		return -EINVAL;
+
+	if (value < ea->min || value > ea->max)
+		return -EINVAL;
+
+	write_seqlock(&sdev->cfg_lock);
+	*(int *)((char *)&sdev->cfg + ea->offset) = value;
+	write_sequnlock(&sdev->cfg_lock);
+
+	if (ea->changed)
+		ea->changed(sdev, value);
+
+	pr_info("SimTemp: New %s %d\n", attr->attr.name, value);
+	return count;
+}
+
+/* * THRESHOLD
+ */
+
+// The value must be in m°C, the trip of the thermal zone follows it
+SIMTEMP_CFG_ATTR_INT_CHANGED(threshold_mc, INT_MIN, INT_MAX, simtemp_thermal_set_trip);
+
+/* * AGGREGATION
+ */
+
+// Window length in samples and/or milliseconds, whichever closes first (0 = unused)
+SIMTEMP_CFG_ATTR_INT(agg_samples, 0, INT_MAX);
+SIMTEMP_CFG_ATTR_INT(agg_window_ms, 0, 3600000);
+
+/* * NOISE
+ */
+
+// Values of the noisy mode fall in [base, base + noise_mc)
+SIMTEMP_CFG_ATTR_INT(noise_mc, 0, SIMTEMP_GEN_MAX_NOISE_mC);
+
+static const char * const simtemp_dist_names[] = {
+	[SIMTEMP_GEN_DIST_UNIFORM]  = "uniform",
+	[SIMTEMP_GEN_DIST_GAUSSIAN] = "gaussian",
+};
+
+static ssize_t noise_dist_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	struct simtemp_config cfg;
+
+	simtemp_config_get(sdev, &cfg);
+
+	return sprintf(buf, "%s\n", simtemp_dist_names[cfg.noise_dist]);
+}
+
+static ssize_t noise_dist_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	int dist;
+
+	dist = sysfs_match_string(simtemp_dist_names, buf);
+	if (dist < 0)
+		return -EINVAL;
+
+	write_seqlock(&sdev->cfg_lock);
+	sdev->cfg.noise_dist = dist;
+	write_sequnlock(&sdev->cfg_lock);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(noise_dist);
+
+/* * SEED
+ */
+
+static ssize_t seed_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	struct simtemp_config cfg;
+
+	simtemp_config_get(sdev, &cfg);
+
+	return sprintf(buf, "%u\n", cfg.seed);
+}
+
+static ssize_t seed_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	u32 value;
+
+	if (kstrtou32(buf, 0, &value))
+		return -EINVAL;
+
+	// The producer owns the generator state and reseeds on its next sample,
+	// so the same seed always replays the same sequence
+	write_seqlock(&sdev->cfg_lock);
+	sdev->cfg.seed = value;
+	sdev->cfg.seed_gen++;
+	write_sequnlock(&sdev->cfg_lock);
+
+	pr_info("SimTemp: New seed %u\n", value);
+	return count;
+}
+
+static DEVICE_ATTR_RW(seed);
+
+/* * SAMPLING_MS / SAMPLING_US
+ */
+
+/*
+ * Both attributes write the same period, keep the two views in step and
+ * re-arm the producer so the new period does not wait for the old one
  */
+static int simtemp_config_set_period(struct simtemp_dev *sdev, int period_us)
+{
+	if (down_interruptible(&sdev->sem))
+		return -ERESTARTSYS;
+
+	write_seqlock(&sdev->cfg_lock);
+	sdev->cfg.sampling_us = period_us;
+	sdev->cfg.sampling_ms = DIV_ROUND_UP(period_us, 1000);
+	write_sequnlock(&sdev->cfg_lock);
+
+	simtemp_producer_rearm(sdev);
+	up(&sdev->sem);
+
+	return 0;
+}
 
 static ssize_t sampling_ms_show(struct device *dev, struct device_attribute *attr, char *buf)
 {
-    struct simtemp_dev *sdev = dev_get_drvdata(dev);
-    int local_sampling_ms; 
-    unsigned long flags;
-    
-    // Show the sample period
-    spin_lock_irqsave(&sdev->state_lock, flags);
-    local_sampling_ms = sdev->sampling_ms;
-    spin_unlock_irqrestore(&sdev->state_lock, flags);
-    
-    return sprintf(buf, "%d\n", local_sampling_ms);
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	struct simtemp_config cfg;
+
+	// Show the sample period
+	simtemp_config_get(sdev, &cfg);
+
+	return sprintf(buf, "%d\n", cfg.sampling_ms);
 }
 
 static ssize_t sampling_ms_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
 {
-    struct simtemp_dev *sdev = dev_get_drvdata(dev);
-    int value = 0;
-	unsigned long flags;
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	int value = 0, ret;
+
+	if (kstrtoint(buf, 10, &value))	  // Convert from string to int
+		return -EINVAL;
 
-    if (kstrtoint(buf, 10, &value))	  // Convert from string to int
-        return -EINVAL;
+	if (value < 10 || value > 10000)  // range from 10ms to 10s for example
+		return -EINVAL;
 
-    if (value < 10 || value > 10000)  // range from 10ms to 10s for example
-        return -EINVAL;
-	
-    spin_lock_irqsave(&sdev->state_lock, flags);
-    sdev->sampling_ms = value;
-    spin_unlock_irqrestore(&sdev->state_lock, flags);
-    pr_info("SimTemp: New sampling frequency %d ms\n", value);
-    
-    return count;
+	ret = simtemp_config_set_period(sdev, value * 1000);
+	if (ret)
+		return ret;
+	pr_info("SimTemp: New sampling frequency %d ms\n", value);
+
+	return count;
 }
 
 static DEVICE_ATTR_RW(sampling_ms);
 
-/* * THRESHOLD
+static ssize_t sampling_us_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	struct simtemp_config cfg;
+
+	simtemp_config_get(sdev, &cfg);
+
+	return sprintf(buf, "%d\n", cfg.sampling_us);
+}
+
+static ssize_t sampling_us_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	int value = 0, ret;
+
+	if (kstrtoint(buf, 10, &value))
+		return -EINVAL;
+
+	// Sub-millisecond periods are only honoured by the kthread producer,
+	// the workqueue keeps rounding up to whole milliseconds (jiffies)
+	if (value < MIN_SAMPLING_US || value > MAX_SAMPLING_US)
+		return -EINVAL;
+
+	ret = simtemp_config_set_period(sdev, value);
+	if (ret)
+		return ret;
+	pr_info("SimTemp: New sampling period %d us\n", value);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(sampling_us);
+
+/* * STATS
+ */
+
+static ssize_t stats_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	struct simtemp_config cfg;
+	// Local variables to safely copy data
+	int local_alerts;
+	unsigned long local_samples, local_overruns, local_slowdowns;
+	unsigned long flags;
+	u64 local_drops, local_overwrites;
+
+	simtemp_config_get(sdev, &cfg);
+
+	spin_lock_irqsave(&sdev->fifo_lock, flags);
+	local_drops = sdev->drops.total;
+	local_overwrites = sdev->drops.overwritten;
+	local_slowdowns = sdev->producer_slowdowns;
+	spin_unlock_irqrestore(&sdev->fifo_lock, flags);
+
+	// Protect counters to be read
+	spin_lock_irqsave(&sdev->state_lock, flags);
+	local_samples = sdev->samples_taken;
+	local_alerts = sdev->count_alerts;
+	local_overruns = sdev->producer_overruns;
+	spin_unlock_irqrestore(&sdev->state_lock, flags);
+
+	// Return the stats
+	return sprintf(buf,
+		"Sampling frequency: %d ms\n"
+		"Threshold: %d m°C\n"
+		"Samples taken: %lu\n"
+		"Sensor mode: %s\n"
+		"Alert counts: %d\n"
+		"Producer overruns: %lu\n"
+		"Channels: %u\n"
+		"FIFO drops: %llu\n"
+		"FIFO overwrites: %llu\n"
+		"Producer slowdowns: %lu\n",
+		cfg.sampling_ms,
+		cfg.threshold_mc,
+		local_samples,
+		simtemp_mode_names[cfg.mode],
+		local_alerts,
+		local_overruns,
+		sdev->channels,
+		local_drops,
+		local_overwrites,
+		local_slowdowns);
+}
+
+static DEVICE_ATTR_RO(stats);
+
+/* * TEMP_mC
+ */
+
+// Newest temperature of channel 0, the FIFO is left alone
+static ssize_t temp_mC_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	struct simtemp_sample_v2 rec;
+	int ret;
+
+	ret = simtemp_latest_get(sdev, 0, &rec);
+	if (ret)
+		return ret;
+
+	return sprintf(buf, "%d\n", rec.temp_mC);
+}
+
+static DEVICE_ATTR_RO(temp_mC);
+
+/* * MODE
+ */
+
+static ssize_t mode_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	struct simtemp_config cfg;
+
+	simtemp_config_get(sdev, &cfg);
+
+	return sprintf(buf, "%s\n", simtemp_mode_names[cfg.mode]); // Show the current mode
+}
+
+static ssize_t mode_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	int mode;
+
+	// Accepts "normal", "noisy", "ramp" or "sine" (trailing newline allowed)
+	mode = sysfs_match_string(simtemp_mode_names, buf);
+	if (mode < 0)
+		return -EINVAL; // Invalid value
+
+	write_seqlock(&sdev->cfg_lock);
+	sdev->cfg.mode = mode;
+	write_sequnlock(&sdev->cfg_lock);
+
+	return count; // Return the number of bytes written
+}
+
+static DEVICE_ATTR_RW(mode); // Expose 'mode' in sysfs
+
+/* * REARM
+ */
+
+static const char * const simtemp_rearm_names[] = {
+	[REARM_IMMEDIATE] = "immediate",
+	[REARM_ALIGNED]   = "aligned",
+	[REARM_DEFERRED]  = "deferred",
+};
+
+static ssize_t rearm_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	struct simtemp_config cfg;
+
+	simtemp_config_get(sdev, &cfg);
+
+	return sprintf(buf, "%s\n", simtemp_rearm_names[cfg.rearm]);
+}
+
+static ssize_t rearm_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	int rearm;
+
+	rearm = sysfs_match_string(simtemp_rearm_names, buf);
+	if (rearm < 0)
+		return -EINVAL;
+
+	write_seqlock(&sdev->cfg_lock);
+	sdev->cfg.rearm = rearm;
+	write_sequnlock(&sdev->cfg_lock);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(rearm);
+
+/* * OVERFLOW
+ */
+
+static const char * const simtemp_overflow_names[] = {
+	[OVERFLOW_DROP_NEWEST]      = "drop_newest",
+	[OVERFLOW_OVERWRITE_OLDEST] = "overwrite_oldest",
+	[OVERFLOW_SLOWDOWN]         = "slowdown",
+};
+
+static ssize_t overflow_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	struct simtemp_config cfg;
+
+	simtemp_config_get(sdev, &cfg);
+
+	return sprintf(buf, "%s\n", simtemp_overflow_names[cfg.overflow]);
+}
+
+static ssize_t overflow_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	int overflow;
+
+	overflow = sysfs_match_string(simtemp_overflow_names, buf);
+	if (overflow < 0)
+		return -EINVAL;
+
+	write_seqlock(&sdev->cfg_lock);
+	sdev->cfg.overflow = overflow;
+	write_sequnlock(&sdev->cfg_lock);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(overflow);
+
+/* * PRODUCER
  */
 
-static ssize_t threshold_mc_show(struct device *dev, struct device_attribute *attr, char *buf)
+static ssize_t producer_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%s\n", sdev->producer == PRODUCER_KTHREAD ? "kthread" : "workqueue");
+}
+
+static ssize_t producer_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	int value, ret = 0;
+
+	if (sysfs_streq(buf, "workqueue"))
+		value = PRODUCER_WORKQUEUE;
+	else if (sysfs_streq(buf, "kthread"))
+		value = PRODUCER_KTHREAD;
+	else
+		return -EINVAL;
+
+	// Producers are swapped under the device semaphore so only one runs at a time
+	if (down_interruptible(&sdev->sem))
+		return -ERESTARTSYS;
+	if (value != sdev->producer) {
+		bool was_running = sdev->producer_running;
+
+		simtemp_producer_stop(sdev);
+		sdev->producer = value;
+		if (was_running)
+			ret = simtemp_producer_start(sdev, 0);
+	}
+	up(&sdev->sem);
+
+	if (ret)
+		return ret;
+
+	pr_info("SimTemp: Producer set to %s\n", value == PRODUCER_KTHREAD ? "kthread" : "workqueue");
+	return count;
+}
+
+static DEVICE_ATTR_RW(producer);
+
+/* * RT_PRIORITY
+ */
+
+static void simtemp_apply_sched(struct simtemp_dev *sdev)
+{
+	struct sched_attr sattr = { .size = sizeof(sattr) };
+
+	if (sdev->rt_priority > 0) {
+		sattr.sched_policy = SCHED_FIFO;
+		sattr.sched_priority = sdev->rt_priority;
+	} else {
+		sattr.sched_policy = SCHED_NORMAL;
+	}
+
+	if (sched_setattr_nocheck(sdev->producer_task, &sattr))
+		pr_warn("SimTemp: Failed to set producer priority %d\n", sdev->rt_priority);
+}
+
+static ssize_t rt_priority_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", sdev->rt_priority);
+}
+
+static ssize_t rt_priority_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	int value = 0;
+
+	if (kstrtoint(buf, 10, &value))
+		return -EINVAL;
+
+	// 0 keeps the kthread in SCHED_NORMAL, 1..99 selects SCHED_FIFO
+	if (value < 0 || value >= MAX_RT_PRIO)
+		return -EINVAL;
+
+	if (down_interruptible(&sdev->sem))
+		return -ERESTARTSYS;
+	sdev->rt_priority = value;
+	if (sdev->producer_task)
+		simtemp_apply_sched(sdev);
+	up(&sdev->sem);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(rt_priority);
+
+/* * PRODUCER_CPU
+ */
+
+static void simtemp_apply_affinity(struct simtemp_dev *sdev)
+{
+	const struct cpumask *mask = sdev->producer_cpu < 0 ? cpu_possible_mask : cpumask_of(sdev->producer_cpu);
+
+	if (set_cpus_allowed_ptr(sdev->producer_task, mask))
+		pr_warn("SimTemp: Failed to pin producer to CPU %d\n", sdev->producer_cpu);
+}
+
+static ssize_t producer_cpu_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", sdev->producer_cpu);
+}
+
+static ssize_t producer_cpu_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	int value = 0;
+
+	if (kstrtoint(buf, 10, &value))
+		return -EINVAL;
+
+	// -1 lets the scheduler place the kthread anywhere
+	if (value < -1 || (value >= 0 && (value >= nr_cpu_ids || !cpu_online(value))))
+		return -EINVAL;
+
+	if (down_interruptible(&sdev->sem))
+		return -ERESTARTSYS;
+	sdev->producer_cpu = value;
+	if (sdev->producer_task)
+		simtemp_apply_affinity(sdev);
+	up(&sdev->sem);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(producer_cpu);
+
+/* * ENABLE / RUN_ON_OPEN
+ */
+
+static ssize_t enable_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", sdev->enabled);
+}
+
+static ssize_t enable_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	bool value;
+
+	if (kstrtobool(buf, &value))
+		return -EINVAL;
+
+	if (down_interruptible(&sdev->sem))
+		return -ERESTARTSYS;
+	sdev->enabled = value;
+	up(&sdev->sem);
+
+	simtemp_producer_update(sdev);
+	return count;
+}
+
+static DEVICE_ATTR_RW(enable);
+
+static ssize_t run_on_open_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", sdev->run_on_open);
+}
+
+static ssize_t run_on_open_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	bool value;
+
+	if (kstrtobool(buf, &value))
+		return -EINVAL;
+
+	if (down_interruptible(&sdev->sem))
+		return -ERESTARTSYS;
+	sdev->run_on_open = value;
+	up(&sdev->sem);
+
+	simtemp_producer_update(sdev);
+	return count;
+}
+
+static DEVICE_ATTR_RW(run_on_open);
+
+/* * ATTRIBUTE GROUP
+ */
+
+/* Registered together with the device so udev never sees it without its attributes */
+static struct attribute *simtemp_attrs[] = {
+	&dev_attr_sampling_ms.attr,
+	&dev_attr_sampling_us.attr,
+	&dev_attr_threshold_mc.attr.attr,
+	&dev_attr_agg_samples.attr.attr,
+	&dev_attr_agg_window_ms.attr.attr,
+	&dev_attr_noise_mc.attr.attr,
+	&dev_attr_noise_dist.attr,
+	&dev_attr_seed.attr,
+	&dev_attr_stats.attr,
+	&dev_attr_temp_mC.attr,
+	&dev_attr_mode.attr,
+	&dev_attr_rearm.attr,
+	&dev_attr_overflow.attr,
+	&dev_attr_producer.attr,
+	&dev_attr_rt_priority.attr,
+	&dev_attr_producer_cpu.attr,
+	&dev_attr_enable.attr,
+	&dev_attr_run_on_open.attr,
+	NULL,
+};
+
+ATTRIBUTE_GROUPS(simtemp);
+
+
+/*
+ * =======================================================
+ * 					FILE OPERATIONS FUNCTIONS
+ * =======================================================
+ */
+ 
+/*
+ * OPEN FUNCTION
+ */
+
+/*
+ * Give the file its own reader state and count readers of both streams,
+ * in run_on_open mode the first one starts the producer
+ */
+static int simtemp_reader_enter(struct simtemp_dev *dev, struct file *flip)
+{
+	struct simtemp_reader *reader;
+	unsigned long flags;
+
+	// Served from the device pool, never a generic kmalloc
+	reader = mempool_alloc(dev->reader_pool, GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+	memset(reader, 0, sizeof(*reader));
+	reader->dev = dev;
+	reader->channel_mask = U64_MAX; // every channel
+	reader->format = SIMTEMP_RECORD_V1;
+
+	INIT_LIST_HEAD(&reader->alert_node);
+	INIT_LIST_HEAD(&reader->sub_node);
+
+	// Losses and alerts before the open are not this file's business
+	spin_lock_irqsave(&dev->fifo_lock, flags);
+	reader->lost_seen = simtemp_core_lost(&dev->drops);
+	spin_unlock_irqrestore(&dev->fifo_lock, flags);
+	spin_lock_irqsave(&dev->state_lock, flags);
+	reader->alert_seen = dev->alert_seq;
+	spin_unlock_irqrestore(&dev->state_lock, flags);
+
+	if (down_interruptible(&dev->sem)) {
+		mempool_free(reader, dev->reader_pool);
+		return -ERESTARTSYS;
+	}
+	dev->open_count++;
+	up(&dev->sem);
+
+	flip->private_data = reader; // Preserving state information
+	simtemp_producer_update(dev);
+
+	return 0;
+}
+
+int simtemp_open(struct inode *inode, struct file *flip)
+{	
+	struct simtemp_dev *dev; // Device information
+
+	dev = container_of(inode->i_cdev, struct simtemp_dev, cdev);
+	
+	return simtemp_reader_enter(dev, flip); 
+}
+
+int simtemp_agg_open(struct inode *inode, struct file *flip)
+{
+	struct simtemp_dev *dev;
+
+	dev = container_of(inode->i_cdev, struct simtemp_dev, agg_cdev);
+
+	return simtemp_reader_enter(dev, flip);
+}
+
+/*
+ * READ FUNCTION
+ */
+
+/*
+ * Queue this file reads from and its loss accounting: its own one once a
+ * channel mask filters something out, the shared FIFO otherwise.
+ * Caller holds fifo_lock
+ */
+static struct kfifo *simtemp_reader_fifo(struct simtemp_reader *reader, struct simtemp_core_drops **drops)
+{
+	if (reader->subscribed) {
+		*drops = &reader->drops;
+		return &reader->fifo;
+	}
+
+	*drops = &reader->dev->drops;
+	return &reader->dev->fifo;
+}
+
+/* Records waiting for this file? */
+static bool simtemp_reader_ready(struct simtemp_reader *reader)
+{
+	struct simtemp_core_drops *drops;
+	unsigned long flags;
+	bool ready;
+
+	spin_lock_irqsave(&reader->dev->fifo_lock, flags);
+	ready = !kfifo_is_empty(simtemp_reader_fifo(reader, &drops));
+	spin_unlock_irqrestore(&reader->dev->fifo_lock, flags);
+
+	return ready;
+}
+
+/*
+ * Move records of this file's queue to the iterator, a pooled staging
+ * batch per fifo_lock hold, until the iterator is full or the queue is
+ * empty. The staging buffer is only taken once records are waiting.
+ * Returns the bytes copied, 0 for an empty queue or a negative error.
+ */
+static ssize_t simtemp_read_records(struct simtemp_reader *reader, struct iov_iter *to,
+				    size_t rec_size, bool nowait)
+{
+	struct simtemp_dev *dev = reader->dev;
+	struct simtemp_core_drops *drops;
+	struct simtemp_sample_v2 *stage;
+	struct kfifo *fifo;
+	size_t want;
+	ssize_t copied = 0;
+	unsigned int i, n;
+	int ret = 0;
+	unsigned long flags;
+
+	if (!simtemp_reader_ready(reader))
+		return 0;
+
+	stage = mempool_alloc(dev->stage_pool, nowait ? GFP_NOWAIT : GFP_KERNEL);
+	if (!stage)
+		return -EAGAIN;
+
+	while ((want = min_t(size_t, iov_iter_count(to) / rec_size, STAGE_RECORDS))) {
+		/* pop up to want samples */
+		spin_lock_irqsave(&dev->fifo_lock, flags);
+		fifo = simtemp_reader_fifo(reader, &drops);
+		n = kfifo_out(fifo, stage, want * sizeof(*stage)) / sizeof(*stage);
+		for (i = 0; i < n; i++)
+			simtemp_core_pop(drops, &stage[i]);
+		reader->lost_seen = simtemp_core_lost(drops);
+		spin_unlock_irqrestore(&dev->fifo_lock, flags);
+
+		if (!n)
+			break;
+
+		// Pack v1 records in place, without the drop counts of v2
+		if (rec_size == sizeof(struct simtemp_sample)) {
+			for (i = 0; i < n; i++) {
+				stage[i].flags &= ~SIMTEMP_FLAG_DROPS_MASK;
+				memmove((char *)stage + i * rec_size, &stage[i], rec_size);
+			}
+		}
+
+		// Copy the batch to user (or to the pipe)
+		if (copy_to_iter(stage, n * rec_size, to) != n * rec_size) {
+			ret = -EFAULT;
+			break;
+		}
+		copied += n * rec_size;
+	}
+
+	mempool_free(stage, dev->stage_pool);
+
+	return copied ? copied : ret;
+}
+
+/*
+ * Fill the iterator with as many whole records as fit (readv scatters them
+ * across its buffers, splice_read hands in a pipe). Only the first record
+ * waits, and not even that one for O_NONBLOCK or IOCB_NOWAIT.
+ */
+ssize_t simtemp_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct file *flip = iocb->ki_filp;
+	struct simtemp_reader *reader = flip->private_data;	// Per file state
+	struct simtemp_dev *dev = reader->dev;	// Pointer to device (simtemp_dev structure)
+	bool nowait = (flip->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT);
+	size_t rec_size;
+	ssize_t ret;
+	
+	// v1 is the first 16 bytes of the v2 record
+	rec_size = READ_ONCE(reader->format) == SIMTEMP_RECORD_V2 ?
+		   sizeof(struct simtemp_sample_v2) : sizeof(struct simtemp_sample);
+
+	// Records are never split across reads
+	if (iov_iter_count(to) < rec_size)
+		return -EINVAL;
+
+	for (;;) {
+		ret = simtemp_read_records(reader, to, rec_size, nowait);
+		if (ret)
+			return ret;
+
+		// Empty (or emptied by another reader of the shared FIFO first)
+		if (nowait)
+			return -EAGAIN;
+		/* block until data present or signal, holding no staging buffer */
+		ret = wait_event_interruptible(dev->read_alert_wq, simtemp_reader_ready(reader));
+		if (ret)
+			return ret; /* -ERESTARTSYS */
+	}
+}
+
+/*
+ * POLL FUNCTION
+ */
+
+unsigned int simtemp_poll(struct file *file, poll_table *wait)
+{
+    struct simtemp_reader *reader = file->private_data;
+    struct simtemp_dev *dev = reader->dev;
+    struct simtemp_core_drops *drops;
+    unsigned int mask = 0;
+    unsigned long flags;
+
+    /* Register the wait queue for poll to observe */
+    poll_wait(file, &dev->read_alert_wq, wait);
+
+    /* Are samples available for this file? => POLLIN/POLLRDNORM */
+    spin_lock_irqsave(&dev->fifo_lock, flags);
+    if (!kfifo_is_empty(simtemp_reader_fifo(reader, &drops)))
+        mask |= POLLIN | POLLRDNORM;
+    /* Samples lost since this file last read? => POLLERR */
+    if (simtemp_core_lost(drops) != reader->lost_seen)
+        mask |= POLLERR;
+    spin_unlock_irqrestore(&dev->fifo_lock, flags);
+
+    /* New alert for this file? => POLLPRI, reported once to a caller asking for it */
+    spin_lock_irqsave(&dev->state_lock, flags);
+    if (dev->alert_seq != reader->alert_seen) {
+        mask |= POLLPRI;
+        if (poll_requested_events(wait) & POLLPRI)
+            reader->alert_seen = dev->alert_seq;
+    }
+    spin_unlock_irqrestore(&dev->state_lock, flags);
+
+    return mask;
+}
+
+/*
+ * ALERT EVENTFD
+ */
+
+/* eventfd_signal() lost its count argument in 6.8 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+#define simtemp_eventfd_signal(ctx) eventfd_signal(ctx)
+#else
+#define simtemp_eventfd_signal(ctx) eventfd_signal(ctx, 1)
+#endif
+
+/* Bind ctx (NULL = unbind) as the alert eventfd of reader, dropping the old one */
+static void simtemp_alert_bind(struct simtemp_reader *reader, struct eventfd_ctx *ctx)
+{
+	struct simtemp_dev *dev = reader->dev;
+	struct eventfd_ctx *old;
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->state_lock, flags);
+	old = reader->alert_ev;
+	reader->alert_ev = ctx;
+	if (ctx && !old)
+		list_add_tail(&reader->alert_node, &dev->alert_readers);
+	else if (!ctx && old)
+		list_del_init(&reader->alert_node);
+	spin_unlock_irqrestore(&dev->state_lock, flags);
+
+	if (old)
+		eventfd_ctx_put(old);
+}
+
+/* One count on every bound eventfd. Caller holds state_lock */
+static void simtemp_alert_signal(struct simtemp_dev *dev)
+{
+	struct simtemp_reader *reader;
+
+	list_for_each_entry(reader, &dev->alert_readers, alert_node)
+		simtemp_eventfd_signal(reader->alert_ev);
+}
+
+
+/*
+ * CHANNEL MASK
+ */
+
+/*
+ * A mask leaving out some channel moves the file to its own queue, which
+ * the producer fills with copies of those channels; the full mask moves it
+ * back to the shared FIFO. The queue is only freed on release, so readers
+ * of this file never see it go away.
+ */
+static int simtemp_reader_set_mask(struct simtemp_reader *reader, u64 channel_mask)
+{
+	struct simtemp_dev *dev = reader->dev;
+	u64 all = GENMASK_ULL(dev->channels - 1, 0);
+	bool subscribe = (channel_mask & all) != all;
+	unsigned long flags;
+	int ret = 0;
+
+	// A queue no record ever reaches would block read() and poll() for good
+	if (!(channel_mask & all))
+		return -EINVAL;
+
+	if (subscribe) {
+		if (down_interruptible(&dev->sem))
+			return -ERESTARTSYS;
+		if (!kfifo_initialized(&reader->fifo))
+			ret = kfifo_alloc(&reader->fifo, kfifo_size(&dev->fifo), GFP_KERNEL);
+		up(&dev->sem);
+		if (ret)
+			return ret;
+	}
+
+	spin_lock_irqsave(&dev->fifo_lock, flags);
+	reader->channel_mask = channel_mask;
+	if (subscribe != reader->subscribed) {
+		if (subscribe) {
+			kfifo_reset(&reader->fifo);
+			list_add_tail(&reader->sub_node, &dev->subscribers);
+		} else {
+			list_del_init(&reader->sub_node);
+		}
+		reader->subscribed = subscribe;
+		// Losses of the queue it read so far are not reported by the other one
+		reader->lost_seen = simtemp_core_lost(subscribe ? &reader->drops : &dev->drops);
+	}
+	spin_unlock_irqrestore(&dev->fifo_lock, flags);
+
+	return 0;
+}
+
+
+/*
+ * IOCTL FUNCTION
+ */
+
+/* First ring position produced at monotonic time >= from_ns. Caller holds history_lock */
+static u64 simtemp_history_find(struct simtemp_dev *dev, u64 oldest, u64 from_ns)
+{
+	// Slots are appended in monotonic order, binary search the live window
+	return simtemp_core_history_find(dev->history, dev->history_mask, oldest, dev->history_head, from_ns);
+}
+
+/* Wall clock time of the query mapped onto CLOCK_MONOTONIC (U64_MAX stays open) */
+static u64 simtemp_history_mono(u64 real_ns, u64 offset_ns)
+{
+	if (real_ns == U64_MAX)
+		return U64_MAX;
+
+	return real_ns > offset_ns ? real_ns - offset_ns : 0;
+}
+
+static long simtemp_history_query(struct simtemp_dev *dev, struct simtemp_history_query __user *uquery)
+{
+	struct simtemp_history_query query;
+	struct simtemp_sample __user *out;
+	struct simtemp_sample *chunk;
+	u64 pos, oldest, head, offset_ns, from_mono, to_mono;
+	u32 copied = 0, n;
+	bool done = false;
+	unsigned long flags;
+	long ret = 0;
+
+	if (!dev->history)
+		return -EOPNOTSUPP;
+
+	if (copy_from_user(&query, uquery, sizeof(query)))
+		return -EFAULT;
+	if (!query.to_ns)
+		query.to_ns = U64_MAX;
+	out = u64_to_user_ptr(query.records);
+
+	// The ring is ordered by CLOCK_MONOTONIC, not by the stepping wall clock
+	offset_ns = ktime_to_ns(ktime_mono_to_real(0));
+	from_mono = simtemp_history_mono(query.from_ns, offset_ns);
+	to_mono = simtemp_history_mono(query.to_ns, offset_ns);
+
+	// A staging buffer holds STAGE_RECORDS v2 records, v1 ones fit as well
+	chunk = mempool_alloc(dev->stage_pool, GFP_KERNEL);
+	if (!chunk)
+		return -ENOMEM;
+
+	spin_lock_irqsave(&dev->history_lock, flags);
+	head = dev->history_head;
+	oldest = head > dev->history_mask + 1ULL ? head - (dev->history_mask + 1ULL) : 0;
+	query.oldest_ns = head ? dev->history[oldest & dev->history_mask].rec.timestamp_ns : 0;
+	pos = simtemp_history_find(dev, oldest, from_mono);
+	spin_unlock_irqrestore(&dev->history_lock, flags);
+
+	// Copy in chunks: the ring lock is never held across copy_to_user()
+	while (!done && copied < query.max_records) {
+		spin_lock_irqsave(&dev->history_lock, flags);
+		head = dev->history_head;
+		oldest = head > dev->history_mask + 1ULL ? head - (dev->history_mask + 1ULL) : 0;
+		if (pos < oldest)
+			pos = oldest; // overwritten by the producer meanwhile
+		for (n = 0; n < STAGE_RECORDS && copied + n < query.max_records; n++, pos++) {
+			if (pos >= head || dev->history[pos & dev->history_mask].mono_ns > to_mono) {
+				done = true;
+				break;
+			}
+			chunk[n] = dev->history[pos & dev->history_mask].rec;
+		}
+		spin_unlock_irqrestore(&dev->history_lock, flags);
+
+		if (n && copy_to_user(out + copied, chunk, n * sizeof(*chunk))) {
+			ret = -EFAULT;
+			break;
+		}
+		copied += n;
+	}
+
+	mempool_free(chunk, dev->stage_pool);
+	if (ret)
+		return ret;
+
+	query.count = copied;
+	if (copy_to_user(uquery, &query, sizeof(query)))
+		return -EFAULT;
+
+	return 0;
+}
+
+long simtemp_ioctl(struct file *flip, unsigned int cmd, unsigned long arg)
+{
+	struct simtemp_reader *reader = flip->private_data;
+	struct simtemp_dev *dev = reader->dev;
+	struct simtemp_latest latest;
+	struct eventfd_ctx *ctx = NULL;
+	u64 channel_mask;
+	u32 format;
+	int ret, fd;
+
+	switch (cmd) {
+	case SIMTEMP_IOC_HISTORY:
+		return simtemp_history_query(dev, (struct simtemp_history_query __user *)arg);
+	case SIMTEMP_IOC_SET_CHANNEL_MASK:
+		if (copy_from_user(&channel_mask, (u64 __user *)arg, sizeof(channel_mask)))
+			return -EFAULT;
+		if (!channel_mask)
+			return -EINVAL;
+		return simtemp_reader_set_mask(reader, channel_mask);
+	case SIMTEMP_IOC_GET_CHANNEL_MASK:
+		channel_mask = READ_ONCE(reader->channel_mask);
+		return copy_to_user((u64 __user *)arg, &channel_mask, sizeof(channel_mask)) ? -EFAULT : 0;
+	case SIMTEMP_IOC_SET_RECORD_FORMAT:
+		if (get_user(format, (u32 __user *)arg))
+			return -EFAULT;
+		if (format != SIMTEMP_RECORD_V1 && format != SIMTEMP_RECORD_V2)
+			return -EINVAL;
+		WRITE_ONCE(reader->format, format);
+		return 0;
+	case SIMTEMP_IOC_GET_RECORD_FORMAT:
+		format = READ_ONCE(reader->format);
+		return put_user(format, (u32 __user *)arg);
+	case SIMTEMP_IOC_GET_LATEST:
+		if (copy_from_user(&latest, (void __user *)arg, sizeof(latest)))
+			return -EFAULT;
+		ret = simtemp_latest_get(dev, latest.channel, &latest.sample);
+		if (ret)
+			return ret;
+		return copy_to_user((void __user *)arg, &latest, sizeof(latest)) ? -EFAULT : 0;
+	case SIMTEMP_IOC_SET_ALERT_EVENTFD:
+		if (get_user(fd, (int __user *)arg))
+			return -EFAULT;
+		if (fd >= 0) {
+			ctx = eventfd_ctx_fdget(fd);
+			if (IS_ERR(ctx))
+				return PTR_ERR(ctx);
+		}
+		simtemp_alert_bind(reader, ctx);
+		return 0;
+	default:
+		return -ENOTTY;
+	}
+}
+
+/*
+ * AGGREGATE STREAM READ / POLL
+ */
+
+ssize_t simtemp_agg_read(struct file *flip, char __user *buf, size_t count, loff_t *f_pos)
+{
+	struct simtemp_reader *reader = flip->private_data;
+	struct simtemp_dev *dev = reader->dev;
+	struct simtemp_aggregate agg_rec;
+	unsigned long flags, ret_kfifo = 0;
+	int ret = 0;
+
+	if (count < sizeof(agg_rec))
+		return -EINVAL;
+
+	if ((flip->f_flags & O_NONBLOCK) && kfifo_is_empty(&dev->agg_fifo))
+		return -EAGAIN;
+
+	/* block until a window closes or signal */
+	ret = wait_event_interruptible(dev->agg_wq, !kfifo_is_empty(&dev->agg_fifo));
+	if (ret)
+		return ret; /* -ERESTARTSYS */
+
+	/* pop one aggregate */
+	spin_lock_irqsave(&dev->fifo_lock, flags);
+	ret_kfifo = kfifo_out(&dev->agg_fifo, &agg_rec, sizeof(agg_rec));
+	spin_unlock_irqrestore(&dev->fifo_lock, flags);
+	if (ret_kfifo != sizeof(agg_rec))
+		return -EAGAIN; /* race with another reader */
+
+	if (copy_to_user(buf, &agg_rec, sizeof(agg_rec)))
+		return -EFAULT;
+
+	return sizeof(agg_rec);
+}
+
+unsigned int simtemp_agg_poll(struct file *file, poll_table *wait)
+{
+	struct simtemp_reader *reader = file->private_data;
+	struct simtemp_dev *dev = reader->dev;
+	unsigned int mask = 0;
+	unsigned long flags;
+
+	poll_wait(file, &dev->agg_wq, wait);
+
+	spin_lock_irqsave(&dev->fifo_lock, flags);
+	if (!kfifo_is_empty(&dev->agg_fifo))
+		mask |= POLLIN | POLLRDNORM;
+	spin_unlock_irqrestore(&dev->fifo_lock, flags);
+
+	return mask;
+}
+
+
+/*
+ * RELEASE FUNCTION
+ */
+
+int simtemp_release(struct inode *inode, struct file *flip)
+{
+	struct simtemp_reader *reader = flip->private_data;
+	struct simtemp_dev *dev = reader->dev;
+	unsigned long flags;
+
+	// The last reader stops the producer in run_on_open mode
+	down(&dev->sem);
+	dev->open_count--;
+	up(&dev->sem);
+	simtemp_producer_update(dev);
+
+	simtemp_alert_bind(reader, NULL);
+
+	// The producer stops feeding the own queue before it is freed
+	if (kfifo_initialized(&reader->fifo)) {
+		spin_lock_irqsave(&dev->fifo_lock, flags);
+		list_del_init(&reader->sub_node);
+		reader->subscribed = false;
+		spin_unlock_irqrestore(&dev->fifo_lock, flags);
+		kfifo_free(&reader->fifo);
+	}
+	mempool_free(reader, dev->reader_pool);
+
+	return(0);
+}
+
+
+/*
+ * =======================================================
+ * 					GENERATE TEMPERATURE
+ * =======================================================
+ */
+
+/* Temperatures of one sampling period for n channels, see simtemp_gen.h */
+void generate_temperature_batch(struct simtemp_dev *sdev, const struct simtemp_config *cfg, s32 *temps, unsigned int n) {
+    struct simtemp_gen_params params = {
+        .mode = cfg->mode,
+        .base_mC = BASE_TEMP_mC,
+        .spread_mC = CHANNEL_SPREAD_mC,     // Each channel sits a little above the previous one
+        .noise_mC = cfg->noise_mc,
+        .dist = cfg->noise_dist,
+        .ramp_step_mC = RAMP_STEP_mC,
+        .amplitude_mC = SINE_AMPLITUDE_mC,
+    };
+    
+    // A new seed restarts the whole sequence (noise, ramp and sine phase)
+    if (sdev->gen_seed_gen != cfg->seed_gen) {
+        simtemp_gen_seed(&sdev->gen, cfg->seed);
+        sdev->gen_seed_gen = cfg->seed_gen;
+    }
+    
+    simtemp_gen_channels(&sdev->gen, &params, temps, n);
+}
+
+/*
+ * Push n records into fifo, applying overflow when they do not fit. Losses
+ * are counted in drops and reported by the records around them
+ * (simtemp_core.h). Returns the records queued. Caller holds fifo_lock
+ */
+static unsigned int simtemp_fifo_push(struct kfifo *fifo, struct simtemp_core_drops *drops, int overflow,
+				      struct simtemp_sample_v2 *rec, unsigned int n)
+{
+	struct simtemp_sample_v2 old;
+	unsigned int room, used, discard, pushed;
+
+	room = kfifo_avail(fifo) / sizeof(*rec);
+	used = kfifo_len(fifo) / sizeof(*rec);
+
+	if (overflow == OVERFLOW_OVERWRITE_OLDEST) {
+		discard = simtemp_core_overwrite(drops, n, room, used);
+		room += discard;
+		while (discard--) {
+			if (kfifo_out(fifo, &old, sizeof(old)) != sizeof(old))
+				break;
+			simtemp_core_discard(drops, &old);
+		}
+	}
+
+	pushed = simtemp_core_admit(drops, rec, n, room);
+	if (pushed)
+		kfifo_in(fifo, rec, pushed * sizeof(*rec));
+
+	return pushed;
+}
+
+/*
+ * Push the n records of one producer pass under a single FIFO lock hold:
+ * all of them into the shared FIFO, and the channels of every filtered
+ * file into its own queue, applying cfg->overflow to each.
+ * Returns the records queued in the shared FIFO, -ENOSPC if none was.
+ */
+static int simtemp_sample_enqueue(struct simtemp_dev *dev_s, const struct simtemp_config *cfg,
+				  struct simtemp_sample_v2 *rec, unsigned int n, bool alert)
+{
+	struct simtemp_reader *reader;
+	unsigned long flags;
+	unsigned int pushed, fanned = 0, m;
+
+	spin_lock_irqsave(&dev_s->fifo_lock, flags);
+	pushed = simtemp_fifo_push(&dev_s->fifo, &dev_s->drops, cfg->overflow, rec, n);
+
+	list_for_each_entry(reader, &dev_s->subscribers, sub_node) {
+		m = simtemp_core_deliver(rec, n, reader->channel_mask, dev_s->sub_records);
+		fanned += simtemp_fifo_push(&reader->fifo, &reader->drops, cfg->overflow, dev_s->sub_records, m);
+	}
+
+	// Slowdown: stretch the period while the consumer lags, relax it again
+	// once the FIFO has drained below half
+	if (cfg->overflow == OVERFLOW_SLOWDOWN && pushed < n) {
+		if (dev_s->period_shift < MAX_PERIOD_SHIFT)
+			dev_s->period_shift++;
+		dev_s->producer_slowdowns++;
+	} else if (dev_s->period_shift && kfifo_len(&dev_s->fifo) < kfifo_size(&dev_s->fifo) / 2) {
+		dev_s->period_shift--;
+	}
+	spin_unlock_irqrestore(&dev_s->fifo_lock, flags);
+
+	// If a sample crosses the threshold, raise a new alert
+	if (alert) {
+		spin_lock_irqsave(&dev_s->state_lock, flags);
+		dev_s->alert_seq++;
+		dev_s->count_alerts++;
+		simtemp_alert_signal(dev_s);
+		spin_unlock_irqrestore(&dev_s->state_lock, flags);
+	}
+
+	// Readers only need waking for new records or an alert; a full FIFO
+	// with neither already has its readers awake. The key lets epoll skip
+	// waiters that did not ask for that event
+	if (pushed || fanned || alert)
+		wake_up_interruptible_poll(&dev_s->read_alert_wq,
+					   (pushed || fanned ? EPOLLIN | EPOLLRDNORM : 0) | (alert ? EPOLLPRI : 0));
+
+	return pushed ? pushed : -ENOSPC;
+}
+
+/* Sampling period in us, stretched by the slowdown policy */
+static unsigned int simtemp_period_us(struct simtemp_dev *dev, const struct simtemp_config *cfg)
+{
+	u64 period = (u64)cfg->sampling_us << READ_ONCE(dev->period_shift);
+
+	return min_t(u64, period, MAX_SAMPLING_US);
+}
+
+
+/*
+ * =======================================================
+ * 					AGGREGATION
+ * =======================================================
+ */
+
+/*
+ * Fold the records of one pass into the window of their channel and, for
+ * each window that closes (agg_samples passes or agg_window_ms elapsed),
+ * push one min/max/mean record to the aggregate stream. Runs in the
+ * producer only.
+ */
+static void simtemp_aggregate_pass(struct simtemp_dev *dev, const struct simtemp_config *cfg,
+				   const struct simtemp_sample_v2 *rec, unsigned int n)
+{
+	struct simtemp_aggregate agg_rec;
+	unsigned long flags;
+	unsigned int ch, closed = 0;
+	s64 now;
+
+	if (!cfg->agg_samples && !cfg->agg_window_ms)
+		return;
+
+	now = ktime_get_ns();
+	for (ch = 0; ch < n; ch++) {
+		if (!simtemp_core_agg_add(&dev->agg[ch], &rec[ch], now, cfg->agg_samples, cfg->agg_window_ms, &agg_rec))
+			continue;
+
+		// A full aggregate FIFO drops the window, like the sample FIFO
+		spin_lock_irqsave(&dev->fifo_lock, flags);
+		if (!kfifo_is_full(&dev->agg_fifo))
+			kfifo_in(&dev->agg_fifo, &agg_rec, sizeof(agg_rec));
+		spin_unlock_irqrestore(&dev->fifo_lock, flags);
+		closed++;
+	}
+
+	if (closed)
+		wake_up_interruptible(&dev->agg_wq);
+}
+
+
+/*
+ * =======================================================
+ * 					HISTORY
+ * =======================================================
+ */
+
+/* Append every produced sample to the history ring, overwriting the oldest */
+static void simtemp_history_append(struct simtemp_dev *dev, const struct simtemp_sample_v2 *rec, ktime_t mono)
+{
+	struct simtemp_core_hist *slot;
+	unsigned long flags;
+
+	if (!dev->history)
+		return;
+
+	spin_lock_irqsave(&dev->history_lock, flags);
+	slot = &dev->history[dev->history_head & dev->history_mask];
+	slot->mono_ns = ktime_to_ns(mono);
+	slot->rec.timestamp_ns = rec->timestamp_ns;
+	slot->rec.temp_mC = rec->temp_mC;
+	slot->rec.flags = rec->flags & ~SIMTEMP_FLAG_DROPS_MASK;
+	dev->history_head++;
+	spin_unlock_irqrestore(&dev->history_lock, flags);
+}
+
+
+/*
+ * =======================================================
+ * 					PRODUCE SAMPLE
+ * =======================================================
+ */
+
+/*
+ * Shared by both producers: generate one sample and push it into the FIFO.
+ * cfg is the snapshot the caller took for this period.
+ */
+static void simtemp_produce_sample(struct simtemp_dev *dev, const struct simtemp_config *cfg)
+{
+	struct simtemp_sample_v2 *rec = dev->records;
+	unsigned long flags;
+	unsigned int ch;
+	ktime_t now;
+	bool alert;
+	
+	// One pass generates every channel with the same timestamp
+	generate_temperature_batch(dev, cfg, dev->temps, dev->channels);
+	now = ktime_get();
+	alert = simtemp_core_records(rec, dev->temps, dev->channels, ktime_get_real_ns(),
+				     cfg->threshold_mc, &dev->next_seq);
+	simtemp_latest_set(dev, rec, dev->channels);
+	simtemp_iio_poll(dev);
+	simtemp_thermal_notify(dev);
+	
+	spin_lock_irqsave(&dev->state_lock, flags);
+	dev->samples_taken += dev->channels;
+	dev->last_sample_time = now;
+	spin_unlock_irqrestore(&dev->state_lock, flags);
+	
+	// Introduce the return values into the FIFO, losses are counted there
+	simtemp_sample_enqueue(dev, cfg, rec, dev->channels, alert);
+
+	// Keep them for late consumers, even if the FIFO dropped them
+	for (ch = 0; ch < dev->channels; ch++)
+		simtemp_history_append(dev, &rec[ch], now);
+
+	// Decimated min/max/mean stream, one window per channel
+	simtemp_aggregate_pass(dev, cfg, rec, dev->channels);
+}
+
+
+/*
+ * =======================================================
+ * 					WORKQUEUE FUNCTION
+ * =======================================================
+ */
+static void workqueue_function(struct work_struct *work){
+	
+	struct simtemp_config cfg;
+	
+	// Cast to delayed_work
+	struct delayed_work *dwork = to_delayed_work(work);
+	
+	// Pointer to the simtemp_drivers structure where the counter is
+	struct simtemp_dev *dev = container_of(dwork, struct simtemp_dev, my_work_delay);
+	
+	simtemp_config_get(dev, &cfg);
+	simtemp_produce_sample(dev, &cfg);
+	
+	// Reschedule delay to be periodic
+	queue_delayed_work(my_workqueue, dwork, usecs_to_jiffies(simtemp_period_us(dev, &cfg)));
+}
+
+
+/*
+ * =======================================================
+ * 					KTHREAD FUNCTION
+ * =======================================================
+ */
+
+/*
+ * Dedicated sampling loop. Sleeps on an hrtimer sleeper until an absolute
+ * CLOCK_MONOTONIC deadline, so the time spent producing a sample does not
+ * accumulate as drift and the period is not rounded to jiffies.
+ */
+static int kthread_function(void *data)
+{
+	struct simtemp_dev *dev = data;
+	struct simtemp_config cfg;
+	unsigned long flags;
+	u64 period_ns, missed;
+	ktime_t now;
+
+	while (!kthread_should_stop()) {
+		// Pick up a deadline requested by simtemp_producer_rearm()
+		spin_lock_irqsave(&dev->state_lock, flags);
+		if (dev->rearm_pending) {
+			dev->kthread_deadline = dev->rearm_deadline;
+			dev->rearm_pending = false;
+		}
+		spin_unlock_irqrestore(&dev->state_lock, flags);
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop() || READ_ONCE(dev->rearm_pending)) {
+			__set_current_state(TASK_RUNNING);
+			continue;
+		}
+		schedule_hrtimeout_range(&dev->kthread_deadline, 0, HRTIMER_MODE_ABS);
+
+		// Woken early (kthread_stop, re-arm or a stray wakeup): start over
+		if (READ_ONCE(dev->rearm_pending) || ktime_before(ktime_get(), dev->kthread_deadline))
+			continue;
+
+		simtemp_config_get(dev, &cfg);
+		simtemp_produce_sample(dev, &cfg);
+
+		period_ns = (u64)simtemp_period_us(dev, &cfg) * NSEC_PER_USEC;
+		dev->kthread_deadline = ktime_add_ns(dev->kthread_deadline, period_ns);
+
+		// Missed deadlines (preempted, slow consumer path...): skip the whole
+		// periods that already passed instead of bursting to catch up, so
+		// the phase is kept, and count every one of them
+		now = ktime_get();
+		if (ktime_before(dev->kthread_deadline, now)) {
+			missed = div64_u64(ktime_to_ns(ktime_sub(now, dev->kthread_deadline)), period_ns) + 1;
+			dev->kthread_deadline = ktime_add_ns(dev->kthread_deadline, missed * period_ns);
+			spin_lock_irqsave(&dev->state_lock, flags);
+			dev->producer_overruns += missed;
+			spin_unlock_irqrestore(&dev->state_lock, flags);
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+ * =======================================================
+ * 					PRODUCER START / STOP
+ * =======================================================
+ */
+
+/* Start the selected producer, first sample after delay_ms. Caller holds dev->sem */
+static int simtemp_producer_start(struct simtemp_dev *dev, unsigned int delay_ms)
+{
+	struct task_struct *task;
+
+	if (dev->producer_running)
+		return 0;
+	if (dev->removing)
+		return -ENODEV;
+
+	if (dev->producer == PRODUCER_WORKQUEUE) {
+		queue_delayed_work(my_workqueue, &dev->my_work_delay, msecs_to_jiffies(delay_ms));
+		dev->producer_running = true;
+		return 0;
+	}
+
+	task = kthread_create(kthread_function, dev, "simtemp/%u", simtemp_minor);
+	if (IS_ERR(task)) {
+		pr_err("SimTemp: Failed to create producer thread\n");
+		return PTR_ERR(task);
+	}
+
+	dev->producer_task = task;
+	dev->kthread_deadline = ktime_add_ms(ktime_get(), delay_ms);
+	dev->rearm_pending = false;
+	simtemp_apply_sched(dev);
+	simtemp_apply_affinity(dev);
+	wake_up_process(task);
+	dev->producer_running = true;
+
+	return 0;
+}
+
+/* Stop whichever producer is running and wait for it. Caller holds dev->sem */
+static void simtemp_producer_stop(struct simtemp_dev *dev)
+{
+	if (dev->producer_task) {
+		kthread_stop(dev->producer_task);
+		dev->producer_task = NULL;
+	}
+
+	// Also handles the self re-queueing delayed work
+	cancel_delayed_work_sync(&dev->my_work_delay);
+	dev->producer_running = false;
+}
+
+/*
+ * Move the next sample of the running producer after a period change,
+ * according to the configured re-arm policy. Caller holds dev->sem
+ */
+static void simtemp_producer_rearm(struct simtemp_dev *dev)
+{
+	struct simtemp_config cfg;
+	ktime_t now = ktime_get(), next;
+	unsigned long flags;
+
+	if (!dev->producer_running)
+		return;
+
+	simtemp_config_get(dev, &cfg);
+
+	switch (cfg.rearm) {
+	case REARM_DEFERRED:
+		return;
+	case REARM_ALIGNED:
+		// Keep the phase of the last sample, never schedule in the past
+		spin_lock_irqsave(&dev->state_lock, flags);
+		next = ktime_add_us(dev->last_sample_time, cfg.sampling_us);
+		spin_unlock_irqrestore(&dev->state_lock, flags);
+		if (ktime_before(next, now))
+			next = now;
+		break;
+	case REARM_IMMEDIATE:
+	default:
+		next = now;
+		break;
+	}
+
+	if (dev->producer == PRODUCER_KTHREAD) {
+		if (!dev->producer_task)
+			return;
+		spin_lock_irqsave(&dev->state_lock, flags);
+		dev->rearm_deadline = next;
+		dev->rearm_pending = true;
+		spin_unlock_irqrestore(&dev->state_lock, flags);
+		wake_up_process(dev->producer_task);
+	} else {
+		mod_delayed_work(my_workqueue, &dev->my_work_delay,
+				 usecs_to_jiffies(ktime_us_delta(next, now)));
+	}
+}
+
+/*
+ * Start or stop the producer so it only runs when it is enabled and, in
+ * run_on_open mode, while somebody has the device open. With runtime PM
+ * the decision is expressed as a usage reference and the PM callbacks do
+ * the actual start/stop.
+ */
+static void simtemp_producer_update(struct simtemp_dev *dev)
+{
+	bool want;
+	int ret = 0;
+
+	// One decision at a time, from the check to the start/stop. sem cannot
+	// be held across it: the runtime PM callbacks take it
+	mutex_lock(&dev->update_lock);
+
+	down(&dev->sem);
+	want = dev->enabled && (!dev->run_on_open || dev->open_count > 0);
+	up(&dev->sem);
+	if (want == dev->producer_wanted)
+		goto out;
+
+	if (dev->dev && pm_runtime_enabled(dev->dev)) {
+		if (want) {
+			ret = pm_runtime_get_sync(dev->dev);
+			if (ret < 0)
+				pm_runtime_put_noidle(dev->dev);
+		} else {
+			pm_runtime_put(dev->dev);
+		}
+	} else {
+		down(&dev->sem);
+		if (want)
+			ret = simtemp_producer_start(dev, 0);
+		else
+			simtemp_producer_stop(dev);
+		up(&dev->sem);
+	}
+
+	// A failed start is retried by the next update
+	if (ret < 0)
+		pr_warn("SimTemp: Failed to start the producer (%d)\n", ret);
+	else
+		dev->producer_wanted = want;
+
+	out:
+		mutex_unlock(&dev->update_lock);
+}
+
+
+/*
+ * =======================================================
+ * 					RUNTIME PM
+ * =======================================================
+ */
+
+static int simtemp_runtime_suspend(struct device *dev)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+
+	down(&sdev->sem);
+	simtemp_producer_stop(sdev);
+	up(&sdev->sem);
+
+	return 0;
+}
+
+static int simtemp_runtime_resume(struct device *dev)
+{
+	struct simtemp_dev *sdev = dev_get_drvdata(dev);
+	int ret;
+
+	down(&sdev->sem);
+	ret = simtemp_producer_start(sdev, 0);
+	up(&sdev->sem);
+
+	return ret;
+}
+
+static const struct dev_pm_ops simtemp_pm_ops = {
+	RUNTIME_PM_OPS(simtemp_runtime_suspend, simtemp_runtime_resume, NULL)
+};
+
+
+/*
+ * =======================================================
+ * 					THERMAL ZONE
+ * =======================================================
+ */
+
+#if IS_ENABLED(CONFIG_THERMAL)
+/* Latest sample of channel 0, the FIFO and its lock are not involved */
+static int simtemp_tz_get_temp(struct thermal_zone_device *tz, int *temp)
+{
+	struct simtemp_dev *dev = thermal_zone_device_priv(tz);
+	struct simtemp_sample_v2 rec;
+
+	// -EAGAIN keeps the thermal core quiet until the first sample
+	if (simtemp_latest_get(dev, 0, &rec))
+		return -EAGAIN;
+	*temp = rec.temp_mC;
+
+	return 0;
+}
+
+static const struct thermal_zone_device_ops simtemp_tz_ops = {
+	.get_temp = simtemp_tz_get_temp,
+};
+
+/*
+ * Register the device as a thermal zone with one passive trip at the
+ * current threshold, so governors and cooling devices can bind to it
+ */
+static int simtemp_thermal_register(struct simtemp_dev *dev, const char *type)
+{
+	struct simtemp_config cfg;
+	struct thermal_zone_device *tz;
+	int ret;
+
+	simtemp_config_get(dev, &cfg);
+	dev->trips[0].temperature = cfg.threshold_mc;
+	dev->trips[0].hysteresis = 0;
+	dev->trips[0].type = THERMAL_TRIP_PASSIVE;
+
+	// The mask of writable trips is gone from 6.11 on
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 11, 0)
+	tz = thermal_zone_device_register_with_trips(type, dev->trips, ARRAY_SIZE(dev->trips), dev,
+						     &simtemp_tz_ops, NULL, 0, thermal_polling_ms);
+#else
+	tz = thermal_zone_device_register_with_trips(type, dev->trips, ARRAY_SIZE(dev->trips), 0, dev,
+						     &simtemp_tz_ops, NULL, 0, thermal_polling_ms);
+#endif
+	if (IS_ERR(tz))
+		return PTR_ERR(tz);
+
+	ret = thermal_zone_device_enable(tz);
+	if (ret) {
+		thermal_zone_device_unregister(tz);
+		return ret;
+	}
+
+	dev->tz = tz;
+	return 0;
+}
+
+static void simtemp_thermal_unregister(struct simtemp_dev *dev)
+{
+	if (dev->tz)
+		thermal_zone_device_unregister(dev->tz);
+	dev->tz = NULL;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+struct simtemp_trip_temp {
+	struct thermal_zone_device *tz;
+	int temp;
+};
+
+static int simtemp_tz_set_trip_temp(struct thermal_trip *trip, void *data)
+{
+	struct simtemp_trip_temp *t = data;
+
+	thermal_zone_set_trip_temp(t->tz, trip, t->temp);
+	return 0;
+}
+#endif
+
+/*
+ * Move the trip to a new threshold and evaluate the zone against it.
+ * dev->tz is set before the sysfs attributes appear and cleared once
+ * they and the producer are gone, so callers need no lock for it.
+ */
+static void simtemp_thermal_set_trip(struct simtemp_dev *dev, int temp)
+{
+	if (!dev->tz)
+		return;
+
+	// The zone keeps its own copy of the trips from 6.9 on, and only
+	// thermal_zone_set_trip_temp() updates it (under the zone lock)
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	thermal_zone_for_each_trip(dev->tz, simtemp_tz_set_trip_temp,
+				   &(struct simtemp_trip_temp){ .tz = dev->tz, .temp = temp });
+#else
+	WRITE_ONCE(dev->trips[0].temperature, temp);
+#endif
+	thermal_zone_device_update(dev->tz, THERMAL_TRIP_CHANGED);
+}
+
+/* Without polling, the thermal core only looks at the zone when told to */
+static void simtemp_thermal_notify(struct simtemp_dev *dev)
+{
+	if (dev->tz && !thermal_polling_ms)
+		thermal_zone_device_update(dev->tz, THERMAL_EVENT_TEMP_SAMPLE);
+}
+#else
+static int simtemp_thermal_register(struct simtemp_dev *dev, const char *type)
+{
+	return -EOPNOTSUPP;
+}
+
+static void simtemp_thermal_unregister(struct simtemp_dev *dev)
+{
+}
+
+static void simtemp_thermal_set_trip(struct simtemp_dev *dev, int temp)
 {
-    struct simtemp_dev *sdev = dev_get_drvdata(dev);
-    int local_threshold_mc;
-    unsigned long flags;
-    
-    // Read the threshold value
-	spin_lock_irqsave(&sdev->state_lock, flags);
-    local_threshold_mc = sdev->threshold_mc;
-    spin_unlock_irqrestore(&sdev->state_lock, flags);
-    
-    return sprintf(buf, "%d\n", local_threshold_mc);
 }
 
-static ssize_t threshold_mc_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+static void simtemp_thermal_notify(struct simtemp_dev *dev)
 {
-    struct simtemp_dev *sdev = dev_get_drvdata(dev);
-    int value = 0;
-    unsigned long flags;
-	
-	// The value must be in m°C
-    if (kstrtoint(buf, 10, &value))
-        return -EINVAL;
-	// Copy the threshold value
-    spin_lock_irqsave(&sdev->state_lock, flags);
-    sdev->threshold_mc = value;
-    spin_unlock_irqrestore(&sdev->state_lock, flags);
-    
-    pr_info("SimTemp: New alert threshold %d m°C\n", value);
-    return count;
 }
+#endif
 
-static DEVICE_ATTR_RW(threshold_mc);
 
-/* * STATS
+/*
+ * =======================================================
+ * 					IIO FRONT END
+ * =======================================================
  */
 
-static ssize_t stats_show(struct device *dev, struct device_attribute *attr, char *buf)
+#if IS_ENABLED(CONFIG_IIO_TRIGGERED_BUFFER)
+/* One scan: channel 0 in milli-degrees plus the IIO timestamp */
+struct simtemp_iio_scan {
+	s32 temp_mC;
+	s64 timestamp __aligned(8);
+};
+
+static const struct iio_chan_spec simtemp_iio_channels[] = {
+	{
+		.type = IIO_TEMP,
+		.info_mask_separate = BIT(IIO_CHAN_INFO_RAW) | BIT(IIO_CHAN_INFO_SCALE),
+		.scan_index = 0,
+		.scan_type = {
+			.sign = 's',
+			.realbits = 32,
+			.storagebits = 32,
+			.endianness = IIO_CPU,
+		},
+	},
+	IIO_CHAN_SOFT_TIMESTAMP(1),
+};
+
+static int simtemp_iio_read_raw(struct iio_dev *indio_dev, struct iio_chan_spec const *chan,
+				int *val, int *val2, long mask)
 {
-	struct simtemp_dev *sdev = dev_get_drvdata(dev);
-	// Local variables to safely copy data
-    int local_sampling, local_threshold, local_alerts;
-    unsigned long local_samples;
-    char local_mode[16];
-    unsigned long flags;
-    
-    // Protect variables to be read
-    spin_lock_irqsave(&sdev->state_lock, flags);
-
-    local_sampling = sdev->sampling_ms;
-    local_threshold = sdev->threshold_mc;
-    local_samples = sdev->samples_taken;
-    strncpy(local_mode, sdev->sensor_mode, sizeof(local_mode) - 1);
-    local_alerts = sdev->count_alerts;
-    
-    spin_unlock_irqrestore(&sdev->state_lock, flags);
-    
-    local_mode[sizeof(local_mode) - 1] = '\0'; // Ensure null termination
-    
-    // Return the stats
-    return sprintf(buf,
-        "Sampling frequency: %d ms\n"
-        "Threshold: %d m°C\n"
-        "Samples taken: %lu\n"
-        "Sensor mode: %s\n"
-        "Alert counts: %d\n",
-		local_sampling,
-        local_threshold,
-        local_samples,
-        local_mode,
-        local_alerts);
+	struct simtemp_dev *dev = *(struct simtemp_dev **)iio_priv(indio_dev);
+	struct simtemp_sample_v2 rec;
+	int ret;
+
+	switch (mask) {
+	case IIO_CHAN_INFO_RAW:
+		ret = simtemp_latest_get(dev, 0, &rec);
+		if (ret)
+			return ret;
+		*val = rec.temp_mC;
+		return IIO_VAL_INT;
+	case IIO_CHAN_INFO_SCALE:
+		// IIO temperatures are milli-degrees already
+		*val = 1;
+		return IIO_VAL_INT;
+	default:
+		return -EINVAL;
+	}
 }
 
-static DEVICE_ATTR_RO(stats);
-
-/* * MODE
- */
+static const struct iio_info simtemp_iio_info = {
+	.read_raw = simtemp_iio_read_raw,
+};
 
-static ssize_t mode_show(struct device *dev, struct device_attribute *attr, char *buf) {
-    struct simtemp_dev *sdev = dev_get_drvdata(dev);
-    char local_mode[16];
-    unsigned long flags;
-    
-    // Read the mode value
-	spin_lock_irqsave(&sdev->state_lock, flags);
-    strncpy(local_mode, sdev->sensor_mode, sizeof(local_mode) - 1);
-    spin_unlock_irqrestore(&sdev->state_lock, flags);
-    
-    return sprintf(buf, "%s\n", local_mode); // Show the current mode
+/* Bottom half of whichever trigger is attached (ours, hrtimer, sysfs, ...) */
+static irqreturn_t simtemp_iio_trigger_handler(int irq, void *p)
+{
+	struct iio_poll_func *pf = p;
+	struct iio_dev *indio_dev = pf->indio_dev;
+	struct simtemp_dev *dev = *(struct simtemp_dev **)iio_priv(indio_dev);
+	struct simtemp_iio_scan scan = { };
+	struct simtemp_sample_v2 rec;
+
+	if (!simtemp_latest_get(dev, 0, &rec))
+		scan.temp_mC = rec.temp_mC;
+	iio_push_to_buffers_with_timestamp(indio_dev, &scan, pf->timestamp);
+	iio_trigger_notify_done(indio_dev->trig);
+
+	return IRQ_HANDLED;
 }
 
-static ssize_t mode_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count) {
-    struct simtemp_dev *sdev = dev_get_drvdata(dev);
-    unsigned long flags;
+/* Called by the producer after every sample, process context */
+static void simtemp_iio_poll(struct simtemp_dev *dev)
+{
+	if (!dev->iio_trig)
+		return;
+
+	// iio_trigger_poll_chained() was renamed in 6.4
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+	iio_trigger_poll_nested(dev->iio_trig);
+#else
+	iio_trigger_poll_chained(dev->iio_trig);
+#endif
+}
 
-    // Update the 'mode' value
-    if (strncmp(buf, "normal", 6) == 0) {
-		spin_lock_irqsave(&sdev->state_lock, flags);
-        strncpy(sdev->sensor_mode, "normal", sizeof(sdev->sensor_mode) - 1); // Leave space for '\0'
-        spin_unlock_irqrestore(&sdev->state_lock, flags);
-    }
-    else if (strncmp(buf, "noisy", 5) == 0) {
-		spin_lock_irqsave(&sdev->state_lock, flags);
-        strncpy(sdev->sensor_mode, "noisy", sizeof(sdev->sensor_mode) - 1);
-        spin_unlock_irqrestore(&sdev->state_lock, flags);
-    }
-    else if (strncmp(buf, "ramp", 4) == 0) {
-		spin_lock_irqsave(&sdev->state_lock, flags);
-        strncpy(sdev->sensor_mode, "ramp", sizeof(sdev->sensor_mode) - 1);
-        spin_unlock_irqrestore(&sdev->state_lock, flags);
-    }
-    else {
-        return -EINVAL; // Invalid value
-    }
+/*
+ * IIO device of channel 0 with a triggered buffer. Its default trigger
+ * "<name>-dev" fires once per produced sample; the standard hrtimer and
+ * sysfs triggers can be attached instead through current_trigger.
+ */
+static int simtemp_iio_register(struct simtemp_dev *dev, struct device *parent, const char *name)
+{
+	struct iio_dev *indio_dev;
+	struct iio_trigger *trig;
+	int ret;
+
+	indio_dev = iio_device_alloc(parent, sizeof(dev));
+	if (!indio_dev)
+		return -ENOMEM;
+	*(struct simtemp_dev **)iio_priv(indio_dev) = dev;
+	indio_dev->name = name;
+	indio_dev->info = &simtemp_iio_info;
+	indio_dev->channels = simtemp_iio_channels;
+	indio_dev->num_channels = ARRAY_SIZE(simtemp_iio_channels);
+	indio_dev->modes = INDIO_DIRECT_MODE;
+
+	trig = iio_trigger_alloc(parent, "%s-dev", name);
+	if (!trig) {
+		ret = -ENOMEM;
+		goto fail_trig_alloc;
+	}
+	ret = iio_trigger_register(trig);
+	if (ret)
+		goto fail_trig_register;
+	indio_dev->trig = iio_trigger_get(trig);
+
+	ret = iio_triggered_buffer_setup(indio_dev, iio_pollfunc_store_time,
+					 simtemp_iio_trigger_handler, NULL);
+	if (ret)
+		goto fail_buffer;
+
+	ret = iio_device_register(indio_dev);
+	if (ret)
+		goto fail_register;
+
+	dev->iio = indio_dev;
+	dev->iio_trig = trig;
+	return 0;
+
+	fail_register:
+		iio_triggered_buffer_cleanup(indio_dev);
+	fail_buffer:
+		iio_trigger_unregister(trig);
+	fail_trig_register:
+		iio_trigger_free(trig);
+	fail_trig_alloc:
+		iio_device_free(indio_dev);
+		return ret;
+}
 
-    // Ensure the string is null-terminated
-    sdev->sensor_mode[sizeof(sdev->sensor_mode) - 1] = '\0';
+/* The producer must be stopped: it is the only user of dev->iio_trig */
+static void simtemp_iio_unregister(struct simtemp_dev *dev)
+{
+	struct iio_trigger *trig = dev->iio_trig;
+
+	if (!dev->iio)
+		return;
+
+	dev->iio_trig = NULL;
+	iio_device_unregister(dev->iio);
+	iio_triggered_buffer_cleanup(dev->iio);
+	iio_trigger_unregister(trig);
+	iio_trigger_free(trig);
+	iio_device_free(dev->iio);
+	dev->iio = NULL;
+}
+#else
+static void simtemp_iio_poll(struct simtemp_dev *dev)
+{
+}
 
-    return count; // Return the number of bytes written
+static int simtemp_iio_register(struct simtemp_dev *dev, struct device *parent, const char *name)
+{
+	return -EOPNOTSUPP;
 }
 
-static DEVICE_ATTR_RW(mode); // Expose 'mode' in sysfs
+static void simtemp_iio_unregister(struct simtemp_dev *dev)
+{
+}
+#endif
 
 
 /*
  * =======================================================
- * 					FILE OPERATIONS FUNCTIONS
+ * 					SETUP CHAR DEVICE
  * =======================================================
  */
- 
-/*
- * OPEN FUNCTION
- */
-
-int simtemp_open(struct inode *inode, struct file *flip)
-{	
-	struct simtemp_dev *dev; // Device information
+static int simtemp_setup_cdev(struct cdev *cdev, struct file_operations *fops, int index)
+{
+	int err, devno = MKDEV(simtemp_major, simtemp_minor + index);
 
-	dev = container_of(inode->i_cdev, struct simtemp_dev, cdev);
-	flip->private_data = dev; // Preserving state information
+	cdev_init(cdev, fops);
+	cdev->owner = THIS_MODULE;
+	cdev->ops = fops;
+	err = cdev_add(cdev, devno, 1);
 	
-	return(0); 
+	if(err)
+		printk(KERN_NOTICE "Error %d adding simtemp %d\n",err,index);
+
+	return err;
 }
 
-/*
- * READ FUNCTION
- */
+/* Keep the caches in /proc/slabinfo under their own names, not merged into others */
+#ifdef SLAB_NO_MERGE
+#define SIMTEMP_SLAB_FLAGS (SLAB_HWCACHE_ALIGN | SLAB_NO_MERGE)
+#else
+#define SIMTEMP_SLAB_FLAGS SLAB_HWCACHE_ALIGN
+#endif
 
-ssize_t simtemp_read(struct file *flip, char __user *buf, size_t count, loff_t *f_pos)
+/* Also undoes a partial simtemp_caches_create() */
+static void simtemp_caches_destroy(void)
 {
-	struct simtemp_dev *dev = flip->private_data;	// Pointer to device (simtemp_dev structure)
-	struct simtemp_sample bin_rec;
-	int ret = 0;
-	unsigned long flags, ret_kfifo = 0;
-	
-
-	// if len is greater than count, update len with count to pass the data requested by the user
-	if(count < sizeof(bin_rec))
-		return -EINVAL;
-		
-	/* block until data present or signal */
-    ret = wait_event_interruptible(dev->read_alert_wq, !kfifo_is_empty(&dev->fifo) || signal_pending(current));
-    if (ret)
-        return ret; /* -ERESTARTSYS */
-        
-	/* pop one sample */
-    spin_lock_irqsave(&dev->fifo_lock, flags);
-    ret_kfifo = kfifo_out(&dev->fifo, &bin_rec, sizeof(bin_rec));
-    if (ret_kfifo != sizeof(bin_rec)) {
-        spin_unlock_irqrestore(&dev->fifo_lock, flags);
-        return -EAGAIN; /* race */
-    }
-    spin_unlock_irqrestore(&dev->fifo_lock, flags);
+	kmem_cache_destroy(simtemp_stage_cache);
+	kmem_cache_destroy(simtemp_reader_cache);
+	simtemp_stage_cache = NULL;
+	simtemp_reader_cache = NULL;
+}
 
-	// Clear active alert flag
-	if (dev->alert_pending) {
-		spin_lock_irqsave(&dev->state_lock, flags);
-		dev->alert_pending = false;
-		spin_unlock_irqrestore(&dev->state_lock, flags);
+/* Slab caches of reader contexts and staging buffers, for the module's lifetime */
+static int simtemp_caches_create(void)
+{
+	simtemp_reader_cache = kmem_cache_create("simtemp_reader", sizeof(struct simtemp_reader), 0,
+						 SIMTEMP_SLAB_FLAGS, NULL);
+	simtemp_stage_cache = kmem_cache_create("simtemp_stage", STAGE_RECORDS * sizeof(struct simtemp_sample_v2), 0,
+						SIMTEMP_SLAB_FLAGS, NULL);
+	if (!simtemp_reader_cache || !simtemp_stage_cache) {
+		simtemp_caches_destroy();
+		return -ENOMEM;
 	}
 
-	// Copy structure to user
-	if(copy_to_user(buf, &bin_rec, sizeof(bin_rec)))
-		return -EFAULT;
-	
-	printk(KERN_ALERT "Read is made\n");
+	return 0;
+}
 
-	return sizeof(bin_rec);
+/* Also undoes a partial simtemp_pools_create() */
+static void simtemp_pools_destroy(struct simtemp_dev *dev)
+{
+	mempool_destroy(dev->stage_pool);
+	mempool_destroy(dev->reader_pool);
 }
 
 /*
- * POLL FUNCTION
+ * Per device mempools in front of the slab caches, so open() and read()
+ * keep working from the reserve when the slab allocator is under pressure.
  */
-
-unsigned int simtemp_poll(struct file *file, poll_table *wait)
+static int simtemp_pools_create(struct simtemp_dev *dev)
 {
-    struct simtemp_dev *dev = file->private_data; /* or however you retrieve your struct */
-    unsigned int mask = 0;
-    unsigned long flags;
-
-    /* Register the wait queue for poll to observe */
-    poll_wait(file, &dev->read_alert_wq, wait);
-
-    /* Are samples available? => POLLIN/POLLRDNORM */
-    spin_lock_irqsave(&dev->fifo_lock, flags);
-    if (!kfifo_is_empty(&dev->fifo))
-        mask |= POLLIN | POLLRDNORM;
-    spin_unlock_irqrestore(&dev->fifo_lock, flags);
-
-    /* Is an alert pending? => POLLPRI (or POLLERR as appropriate) */
-    spin_lock_irqsave(&dev->state_lock, flags);
-    if (dev->alert_pending)
-        mask |= POLLPRI;
-    spin_unlock_irqrestore(&dev->state_lock, flags);
+	dev->reader_pool = mempool_create_slab_pool(READER_POOL_MIN, simtemp_reader_cache);
+	dev->stage_pool = mempool_create_slab_pool(STAGE_POOL_MIN, simtemp_stage_cache);
+	if (!dev->reader_pool || !dev->stage_pool) {
+		simtemp_pools_destroy(dev);
+		return -ENOMEM;
+	}
 
-    return mask;
+	return 0;
 }
 
-
 /*
- * RELEASE FUNCTION
+ * kfifo_alloc() on a given node: the buffer comes from kmalloc_node(), so
+ * kfifo_free() releases it like any other.
  */
-
-int simtemp_release(struct inode *inode, struct file *flip)
+static int simtemp_kfifo_alloc_node(struct kfifo *fifo, unsigned int size, int node)
 {
-	return(0);
+	void *buf;
+	int ret;
+
+	size = roundup_pow_of_two(size);
+	buf = kmalloc_node(size, GFP_KERNEL, node);
+	if (!buf)
+		return -ENOMEM;
+	ret = kfifo_init(fifo, buf, size);
+	if (ret)
+		kfree(buf);
+
+	return ret;
 }
 
-
 /*
  * =======================================================
- * 					GENERATE TEMPERATURE
+ * 					PROBE CONFIGURATION
  * =======================================================
  */
 
-u32 generate_temperature_sample(struct simtemp_dev *sdev) {
-    u32 temp;
-    
-    // Check the sensor mode
-    if (strncmp(sdev->sensor_mode, "normal", 6) == 0) {
-        // Generate normal temperature
-        temp = 25000; // Example value
-    } else if (strncmp(sdev->sensor_mode, "noisy", 5) == 0) {
-        // Generate temperature with noise
-        temp = 25000 + (get_random_u32() % 1000); // Noisy range
-    } else if (strncmp(sdev->sensor_mode, "ramp", 4) == 0) {
-        // Generate ramp temperature
-        static u32 ramp_temp = 25000;
-        ramp_temp += 10; // Increase gradually
-        temp = ramp_temp;
-    } else {
-        // Unknown mode, default temperature
-        temp = 25000;
-    }
-    
-    return temp;
+/* Tunables of a device resolved at probe, before anything is allocated */
+struct simtemp_probe_cfg
+{
+	struct simtemp_config cfg;			// Initial configuration
+	unsigned int channels;				// Channels generated per producer pass
+	unsigned int fifo_depth;			// Producer passes the sample FIFO holds
+	int producer;						// PRODUCER_WORKQUEUE or PRODUCER_KTHREAD
+	int producer_cpu;					// CPU of the kthread (-1 = any), picks the NUMA node
+	bool thermal_zone;					// Register a thermal zone
+	unsigned int history_len;			// Records of the history ring (0 = off)
+};
+
+/* Index of name in names, or -EINVAL */
+static int simtemp_match_name(const char * const *names, size_t n, const char *name)
+{
+	return name ? match_string(names, n, name) : -EINVAL;
 }
 
-static int simtemp_sample_enqueue(struct simtemp_dev *dev_s, struct simtemp_sample *sim_s)
+/*
+ * Module parameters give every tunable its value, firmware properties of
+ * the device (DT node, or none for the fallback device) override them.
+ * Out of range values are clamped or ignored with a warning, probe never
+ * fails over configuration.
+ */
+static void simtemp_probe_config(struct device *dev, struct simtemp_probe_cfg *pc)
 {
-    unsigned long flags;
-    int ret;
-    
-	// After updating dev->simtemp
-	spin_lock_irqsave(&dev_s->fifo_lock, flags);
-	if(kfifo_is_full(&dev_s->fifo)){
-		ret = -ENOSPC;
-	} else{
-		ret = kfifo_in(&dev_s->fifo, sim_s, sizeof(*sim_s)); // If using FIFO
+	static const char * const producer_names[] = {
+		[PRODUCER_WORKQUEUE] = "workqueue",
+		[PRODUCER_KTHREAD]   = "kthread",
+	};
+	u64 period_us = (u64)init_sampling_ms * 1000;
+	const char *str;
+	u32 val;
+	int idx;
+
+	pc->cfg = (struct simtemp_config) {
+		.threshold_mc = init_threshold_mc,
+		.mode = MODE_NORMAL,
+		.rearm = REARM_IMMEDIATE,
+		.noise_mc = NOISE_SPAN_mC,
+		.noise_dist = SIMTEMP_GEN_DIST_UNIFORM,
+	};
+	pc->channels = channels;
+	pc->fifo_depth = fifo_depth;
+	pc->producer = PRODUCER_WORKQUEUE;
+	pc->producer_cpu = producer_cpu;
+	pc->thermal_zone = thermal_zone;
+	pc->history_len = min(history_len, MAX_HISTORY_LEN);
+
+	// Strings of the module parameters, then of the firmware
+	idx = simtemp_match_name(simtemp_mode_names, ARRAY_SIZE(simtemp_mode_names), init_mode);
+	if (idx >= 0)
+		pc->cfg.mode = idx;
+	idx = simtemp_match_name(producer_names, ARRAY_SIZE(producer_names), init_producer);
+	if (idx >= 0)
+		pc->producer = idx;
+
+	if (!device_property_read_u32(dev, "sampling-ms", &val))
+		period_us = (u64)val * 1000;
+	if (!device_property_read_u32(dev, "sampling-us", &val))
+		period_us = val;
+	if (!device_property_read_u32(dev, "threshold-mC", &val))
+		pc->cfg.threshold_mc = (s32)val;	// cells are unsigned, <(-5000)> works
+	if (!device_property_read_string(dev, "mode", &str)) {
+		idx = simtemp_match_name(simtemp_mode_names, ARRAY_SIZE(simtemp_mode_names), str);
+		if (idx >= 0)
+			pc->cfg.mode = idx;
+		else
+			dev_warn(dev, "unknown mode \"%s\"\n", str);
 	}
-	spin_unlock_irqrestore(&dev_s->fifo_lock, flags);
-	
-	wake_up_interruptible(&dev_s->read_alert_wq);
-	
-	// If the sample crosses the threshold, mark alert
-	if (sim_s->flags & FLAG_THRESHOLD_CROSSED) {
-		spin_lock_irqsave(&dev_s->state_lock, flags);
-		dev_s->alert_pending = true;
-		spin_unlock_irqrestore(&dev_s->state_lock, flags);
-		// Wake up process due to threshold alert
-		wake_up_interruptible(&dev_s->read_alert_wq);
-		dev_s->count_alerts++;
+	if (!device_property_read_u32(dev, "fifo-depth", &val))
+		pc->fifo_depth = val;
+	if (!device_property_read_u32(dev, "channels", &val))
+		pc->channels = val;
+	if (!device_property_read_string(dev, "producer", &str)) {
+		idx = simtemp_match_name(producer_names, ARRAY_SIZE(producer_names), str);
+		if (idx >= 0)
+			pc->producer = idx;
+		else
+			dev_warn(dev, "unknown producer \"%s\"\n", str);
+	}
+	if (!device_property_read_u32(dev, "producer-cpu", &val))
+		pc->producer_cpu = val;
+	if (device_property_read_bool(dev, "thermal-zone"))
+		pc->thermal_zone = true;
+
+	// Same limits as the sysfs attributes
+	period_us = clamp_t(u64, period_us, MIN_SAMPLING_US, MAX_SAMPLING_US);
+	pc->cfg.sampling_us = period_us;
+	pc->cfg.sampling_ms = DIV_ROUND_UP(pc->cfg.sampling_us, 1000);
+	pc->channels = clamp(pc->channels, 1U, (unsigned int)SIMTEMP_MAX_CHANNELS);
+	pc->fifo_depth = clamp(pc->fifo_depth, 1U, (unsigned int)MAX_FIFO_DEPTH);
+	if (pc->producer_cpu >= 0 && (pc->producer_cpu >= nr_cpu_ids || !cpu_online(pc->producer_cpu))) {
+		dev_warn(dev, "CPU %d not online, producer not pinned\n", pc->producer_cpu);
+		pc->producer_cpu = -1;
 	}
-
-    return ret;
 }
 
 
 /*
  * =======================================================
- * 					WORKQUEUE FUNCTION
+ * 					PROBE / REMOVE
  * =======================================================
  */
-static void workqueue_function(struct work_struct *work){
-	
-	//u32 random_temp = 0;
-	int delay_ms = 5000, ret = 0;
-	static unsigned long countSample = 0;
-	struct simtemp_sample sim_s;
-	
-	// Cast to delayed_work
-	struct delayed_work *dwork = to_delayed_work(work);
-	
-	// Pointer to the simtemp_drivers structure where the counter is
-	struct simtemp_dev *dev = container_of(dwork, struct simtemp_dev, my_work_delay);
-	
-	u32 random_temp = generate_temperature_sample(dev);
-	
-	countSample++;
-	dev->samples_taken = countSample;
-	
-	// Introduce to binary record
-	sim_s.temp_mC = random_temp;
-	sim_s.timestamp_ns = ktime_get_real_ns();
-	sim_s.flags = FLAG_NEW_SAMPLE;
-	
-	// If the threshold is exceeded, set the flag
-	if (sim_s.temp_mC > dev->threshold_mc){
-		sim_s.flags = 0;
-		sim_s.flags = FLAG_THRESHOLD_CROSSED;
+
+static int simtemp_probe(struct platform_device *pdev)
+{
+	struct simtemp_probe_cfg pc;
+	struct simtemp_dev *sdev;
+	int result, node = NUMA_NO_NODE;
+	dev_t devno = MKDEV(simtemp_major, simtemp_minor);
+
+	// One set of minors and one device name: a single instance
+	if (simtemp_device) {
+		dev_err(&pdev->dev, "only one simtemp device is supported\n");
+		return -EBUSY;
+	}
+
+	simtemp_probe_config(&pdev->dev, &pc);
+
+	// ALLOCATE PRIVATE STRUCTURE on the node of the CPU that will produce
+	if (pc.producer_cpu >= 0)
+		node = cpu_to_node(pc.producer_cpu);
+	sdev = kzalloc_node(sizeof(*sdev), GFP_KERNEL, node);
+	if (!sdev)
+		return -ENOMEM;
+	sdev->cfg = pc.cfg;
+	sdev->producer = pc.producer;
+	sdev->producer_cpu = pc.producer_cpu;
+	sdev->enabled = true;
+	INIT_LIST_HEAD(&sdev->alert_readers);
+	INIT_LIST_HEAD(&sdev->subscribers);
+
+	// INITIALIZE PRIVATE STRUCTURE
+	// Initialize locks and waitqueues before using them in workqueue/sysfs
+	sema_init(&sdev->sem, 1);
+	mutex_init(&sdev->update_lock);
+	init_waitqueue_head(&sdev->read_alert_wq);
+	init_waitqueue_head(&sdev->agg_wq);
+	spin_lock_init(&sdev->fifo_lock);
+	spin_lock_init(&sdev->state_lock);
+	seqlock_init(&sdev->cfg_lock);
+	seqcount_init(&sdev->latest_seq);
+	spin_lock_init(&sdev->history_lock);
+
+	// CHANNELS GENERATED PER PASS
+	sdev->channels = pc.channels;
+	// Random seed until one is written to sysfs
+	sdev->cfg.seed = get_random_u32();
+	simtemp_gen_seed(&sdev->gen, sdev->cfg.seed);
+
+	// PREALLOCATE READER CONTEXTS AND STAGING BUFFERS
+	result = simtemp_pools_create(sdev);
+	if (result) {
+		pr_err("SimTemp: Error creating memory pools\n");
+		goto fail_dev;
+	}
+
+	// ALLOCATE KFIFO (room for fifo_depth passes of every channel)
+	result = simtemp_kfifo_alloc_node(&sdev->fifo,
+			     pc.fifo_depth * sdev->channels * sizeof(struct simtemp_sample_v2), node);
+	if (result) {
+		pr_err("SimTemp: Error allocating kfifo\n");
+		goto fail_pools;
+	}
+	result = simtemp_kfifo_alloc_node(&sdev->agg_fifo,
+				     AGG_FIFO_SIZE * sdev->channels * sizeof(struct simtemp_aggregate), node);
+	if (result) {
+		pr_err("SimTemp: Error allocating aggregate kfifo\n");
+		goto fail_kfifo;
 	}
 	
-	// Introduce the return values into the FIFO
-	ret = simtemp_sample_enqueue(dev, &sim_s);
-	if(ret <= 0)
-		pr_info("Full Queue");
-		
+	// ALLOCATE HISTORY RING
+	if (pc.history_len) {
+		sdev->history = vzalloc_node(array_size(roundup_pow_of_two(pc.history_len),
+						       sizeof(struct simtemp_core_hist)), node);
+		if (!sdev->history) {
+			result = -ENOMEM;
+			goto fail_agg_kfifo;
+		}
+		sdev->history_mask = roundup_pow_of_two(pc.history_len) - 1;
+	}
 	
-	// Reschedule delay to be periodic
-	delay_ms = dev->sampling_ms;
-	queue_delayed_work(my_workqueue, dwork, msecs_to_jiffies(delay_ms)); // every 5s
+	// CREATE CDEVS (samples on minor 0, aggregates on minor 1)
+	result = simtemp_setup_cdev(&sdev->cdev, &simtemp_fops, 0);
+	if (result)
+		goto fail_history;
+	result = simtemp_setup_cdev(&sdev->agg_cdev, &simtemp_agg_fops, 1);
+	if (result)
+		goto fail_cdev;
 	
+	// INITIALIZE WORK (cancelled by simtemp_producer_stop())
+	INIT_DELAYED_WORK(&sdev->my_work_delay, workqueue_function);
+
+	// REGISTER THE THERMAL ZONE (optional, the char devices work without it).
+	// Before the attributes, so a threshold store always sees the zone
+	if (pc.thermal_zone) {
+		result = simtemp_thermal_register(sdev, DEVICE_NAME);
+		if (result)
+			pr_warn("SimTemp: Thermal zone not registered (%d)\n", result);
+	}
+
+	// CREATE DEVICE /dev/simtemp0 (with its sysfs attribute group) under
+	// the platform device
+	simtemp_device_f = device_create_with_groups(simtemp_class, &pdev->dev, devno,
+						     sdev, simtemp_groups, DEVICE_NAME);
+	if (IS_ERR(simtemp_device_f)) {
+		result = PTR_ERR(simtemp_device_f);
+		pr_alert("tempsim: failed to create device\n");
+		goto fail_thermal;
+	}
+
+	// The private data pointer is set by device_create_with_groups()
+	// before the attributes become visible
+	sdev->dev = simtemp_device_f;
+
+	// CREATE DEVICE /dev/simtemp0_agg (decimated min/max/mean stream)
+	simtemp_agg_device_f = device_create(simtemp_class, simtemp_device_f, MKDEV(simtemp_major, simtemp_minor + 1),
+					     sdev, AGG_DEVICE_NAME);
+	if (IS_ERR(simtemp_agg_device_f)) {
+		result = PTR_ERR(simtemp_agg_device_f);
+		pr_alert("tempsim: failed to create aggregate device\n");
+		goto fail_device;
+	}
+
+	// REGISTER THE IIO FRONT END (optional as well)
+	if (iio) {
+		result = simtemp_iio_register(sdev, simtemp_device_f, DEVICE_NAME);
+		if (result)
+			pr_warn("SimTemp: IIO device not registered (%d)\n", result);
+	}
+
+	// START THE PRODUCER (first sample after start_delay_ms), unless it
+	// only runs while the device is open. The device is runtime active
+	// exactly while the producer is wanted
+	sdev->run_on_open = run_on_open;
+	if (!run_on_open) {
+		down(&sdev->sem);
+		result = simtemp_producer_start(sdev, start_delay_ms);
+		sdev->producer_wanted = (result == 0);
+		up(&sdev->sem);
+		if (result)
+			goto fail_iio;
+		pm_runtime_set_active(simtemp_device_f);
+		pm_runtime_get_noresume(simtemp_device_f);
+	}
+	pm_runtime_enable(simtemp_device_f);
+
+	platform_set_drvdata(pdev, sdev);
+	simtemp_device = sdev;
+
+	dev_info(&pdev->dev, "%u ch every %d us, threshold %d mC, mode %s, %s producer\n",
+		 sdev->channels, sdev->cfg.sampling_us, sdev->cfg.threshold_mc,
+		 simtemp_mode_names[sdev->cfg.mode], sdev->producer == PRODUCER_KTHREAD ? "kthread" : "workqueue");
+
+	return 0;
+
+	// --- ERROR CLEANUP SECTION (In reverse order) ---
+
+	fail_iio:
+		simtemp_iio_unregister(sdev);
+		device_destroy(simtemp_class, MKDEV(simtemp_major, simtemp_minor + 1));
+
+	fail_device:
+		device_destroy(simtemp_class, devno);
+		// Stop the producer a sysfs write may have started
+		down(&sdev->sem);
+		simtemp_producer_stop(sdev);
+		up(&sdev->sem);
+
+	fail_thermal:
+		simtemp_thermal_unregister(sdev);
+		cdev_del(&sdev->agg_cdev);
+
+	fail_cdev:
+		cdev_del(&sdev->cdev);
+
+	fail_history:
+		vfree(sdev->history);
+
+	fail_agg_kfifo:
+		kfifo_free(&sdev->agg_fifo);
+
+	fail_kfifo:
+		kfifo_free(&sdev->fifo); // free memory allocated for kfifo
+
+	fail_pools:
+		simtemp_pools_destroy(sdev);
 
-	pr_info("Workqueue is runinig");
+	fail_dev:
+		kfree(sdev);
 
+		return result; // Return the original error code
 }
 
-/*
- * =======================================================
- * 					SETUP CHAR DEVICE
- * =======================================================
- */
-static void simtemp_setup_cdev(struct simtemp_dev *dev, int index)
+static void simtemp_remove(struct platform_device *pdev)
 {
-	int err, devno = MKDEV(simtemp_major, simtemp_minor + index);
+	struct simtemp_dev *sdev = platform_get_drvdata(pdev);
+	dev_t devno = MKDEV(simtemp_major, simtemp_minor);
+
+	// Teardown runs in the reverse order of simtemp_probe().
+	// The driver is only unbound by module exit (no bind/unbind attributes)
+	// and open files hold a module reference, so nothing is open here.
+
+	// Runtime PM must not start or stop the producer from now on
+	pm_runtime_disable(simtemp_device_f);
 
-	cdev_init(&dev->cdev, &simtemp_fops);
-	dev->cdev.owner = THIS_MODULE;
-	dev->cdev.ops = &simtemp_fops;
-	err = cdev_add(&dev->cdev, devno, 1);
+	// Stop the producer (kthread or delayed work) for good: sysfs writes
+	// still in flight can no longer start it. IIO goes before its parent
+	// device, once nothing fires the trigger
+	down(&sdev->sem);
+	sdev->removing = true;
+	simtemp_producer_stop(sdev);
+	simtemp_iio_unregister(sdev);
+	up(&sdev->sem);
+
+	// This removes the attribute groups and waits for sysfs writers in flight
+	device_destroy(simtemp_class, MKDEV(simtemp_major, simtemp_minor + 1));
+	device_destroy(simtemp_class, devno);
+	sdev->dev = NULL;
+
+	// Neither sysfs nor the producer use the zone any more. The thermal
+	// core stops calling get_temp before this returns
+	simtemp_thermal_unregister(sdev);
 	
-	if(err)
-		printk(KERN_NOTICE "Error %d adding simtemp %d\n",err,index);
+	// Delete cdevs
+	cdev_del(&sdev->agg_cdev);
+	cdev_del(&sdev->cdev);
+	
+	// Free kfifos
+	kfifo_free(&sdev->fifo);
+	kfifo_free(&sdev->agg_fifo);
+	vfree(sdev->history);
+	simtemp_pools_destroy(sdev);
+	kfree(sdev);
+	simtemp_device = NULL;
+}
+
+static const struct of_device_id simtemp_of_match[] = {
+	{ .compatible = "nxp,simtemp" },
+	{ }
+};
+MODULE_DEVICE_TABLE(of, simtemp_of_match);
+
+static struct platform_driver simtemp_driver = {
+	.probe = simtemp_probe,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 11, 0)
+	.remove = simtemp_remove,
+#else
+	.remove_new = simtemp_remove,
+#endif
+	.driver = {
+		.name = MODULE_NAME,
+		.of_match_table = simtemp_of_match,
+		// Open files pin the module, not the device: no unbind from sysfs
+		.suppress_bind_attrs = true,
+	},
+};
+
+/* Is there a DT node the driver will probe from? */
+static bool simtemp_has_dt_node(void)
+{
+	struct device_node *np = of_find_compatible_node(NULL, NULL, "nxp,simtemp");
+	bool available = np && of_device_is_available(np);
+
+	of_node_put(np);
+	return available;
 }
+
+
 /*
  * =======================================================
  * 						INIT FUNCTION
@@ -529,12 +2886,11 @@ static int __init initialization_function(void)
 	int result;
 	// dev is used to get the major/minor number
 	dev_t devno = 0; 
-	int ret_dv_file_sm, ret_dv_file_th, ret_dv_file_st, ret_dv_file_md;
 	
 	printk(KERN_ALERT "ENTRY TEST\n");
 
 	// GET MAJOR/MINOR (char dev region)
-	result = alloc_chrdev_region(&devno, simtemp_minor, 1, MODULE_NAME);
+	result = alloc_chrdev_region(&devno, simtemp_minor, SIMTEMP_NR_MINORS, MODULE_NAME);
 	simtemp_major = MAJOR(devno);
 	
 	if (result < 0) {
@@ -542,70 +2898,51 @@ static int __init initialization_function(void)
 		goto fail_region; // Nothing to clean up before here
 	}
 	
-	// INITIALIZE PRIVATE STRUCTURE
-	// Initialize locks and waitqueues before using them in workqueue/sysfs
-	sema_init(&simtemp_device.sem, 1);
-	init_waitqueue_head(&simtemp_device.read_alert_wq);
-	spin_lock_init(&simtemp_device.fifo_lock);
-	spin_lock_init(&simtemp_device.state_lock);
-
-	// ALLOCATE KFIFO
-	// Assume SAMPLE_FIFO_SIZE and struct simtemp_sample are globally defined
-	result = kfifo_alloc(&simtemp_device.fifo, SAMPLE_FIFO_SIZE * sizeof(struct simtemp_sample), GFP_KERNEL);
-	if (result) {
-		pr_err("SimTemp: Error allocating kfifo\n");
-		goto fail_region; // Clean up only alloc_chrdev_region
-	}
-	
-	// CREATE CDEV
-	simtemp_setup_cdev(&simtemp_device, 0); // Assume this calls cdev_init and cdev_add
-	if (simtemp_device.cdev.owner != THIS_MODULE) { // Assume an error check
-		result = -ENOMEM; // Generic error code if cdev_add/init fails internally
-		goto fail_kfifo;
-	}
-	
 	// CREATE WORKQUEUE
 	my_workqueue = create_workqueue("my_workqueue");
 	if (my_workqueue == NULL) {
 		result = -ENOMEM;
-		goto fail_cdev;
+		goto fail_region;
+	}
+
+	// CREATE SLAB CACHES (the devices put their mempools in front)
+	result = simtemp_caches_create();
+	if (result) {
+		pr_err("SimTemp: Error creating slab caches\n");
+		goto fail_workqueue;
 	}
-	
-	// INITIALIZE AND ENQUEUE WORK (will be cleaned up with destroy_workqueue)
-	INIT_DELAYED_WORK(&simtemp_device.my_work_delay, workqueue_function);
-	// Enqueue task in 5 secs
-	queue_delayed_work(my_workqueue, &simtemp_device.my_work_delay, msecs_to_jiffies(5000));	
 	
 	// CREATE CLASS /sys/class
 	simtemp_class = class_create(CLASS_NAME);
 	if (IS_ERR(simtemp_class)) {
 		result = PTR_ERR(simtemp_class);
 		pr_alert("tempsim: failed to create class\n");	
-		goto fail_workqueue;
+		goto fail_caches;
  	}
+	// Runtime PM callbacks of the device start/stop the producer
+	simtemp_class->pm = &simtemp_pm_ops;
 
-	// CREATE DEVICE /dev/simtemp0
-	simtemp_device_f = device_create(simtemp_class, NULL, MKDEV(simtemp_major, simtemp_minor), &simtemp_device, DEVICE_NAME);
-	if (IS_ERR(simtemp_device_f)) {
-		result = PTR_ERR(simtemp_device_f);
-		pr_alert("tempsim: failed to create device\n");
+	// REGISTER THE PLATFORM DRIVER (probes a "nxp,simtemp" DT node right away)
+	result = platform_driver_register(&simtemp_driver);
+	if (result)
 		goto fail_class;
+
+	// Without a DT node, create the device here so it probes from the
+	// module parameters alone
+	if (!simtemp_has_dt_node()) {
+		simtemp_pdev = platform_device_register_simple(MODULE_NAME, PLATFORM_DEVID_NONE, NULL, 0);
+		if (IS_ERR(simtemp_pdev)) {
+			result = PTR_ERR(simtemp_pdev);
+			simtemp_pdev = NULL;
+			goto fail_driver;
+		}
 	}
 
-	// ASSOCIATE PRIVATE DATA POINTER
-	dev_set_drvdata(simtemp_device_f, &simtemp_device);
-		
-	// CREATE ATTRIBUTES (sysfs files)
-	ret_dv_file_sm = device_create_file(simtemp_device_f, &dev_attr_sampling_ms);
-	ret_dv_file_th = device_create_file(simtemp_device_f, &dev_attr_threshold_mc);
-	ret_dv_file_st = device_create_file(simtemp_device_f, &dev_attr_stats);
-	ret_dv_file_md = device_create_file(simtemp_device_f, &dev_attr_mode);
-
-	// If attribute creation fails, we must clean up everything
-	if (ret_dv_file_sm < 0 || ret_dv_file_th < 0 || ret_dv_file_st < 0 || ret_dv_file_md < 0) {
-		pr_err("SimTemp: Failed to create sysfs attributes\n");
-		result = -EINVAL; // Or the error code of the first failure
-		goto fail_attributes;
+	// Load fails like before if the device could not come up, from the
+	// DT node (probed synchronously by platform_driver_register()) or not
+	if (!simtemp_device) {
+		result = -ENODEV;
+		goto fail_pdev;
 	}
 	
 	printk(KERN_INFO "SimTemp: Device initialized successfully\n");
@@ -614,32 +2951,26 @@ static int __init initialization_function(void)
 
 	// --- ERROR CLEANUP SECTION (In reverse order) ---
 
-	fail_attributes:
-		// Delete only those that could be created (although device_destroy sometimes cleans this up)
-		device_remove_file(simtemp_device_f, &dev_attr_sampling_ms);
-		device_remove_file(simtemp_device_f, &dev_attr_threshold_mc);
-		device_remove_file(simtemp_device_f, &dev_attr_stats);	
-		device_remove_file(simtemp_device_f, &dev_attr_mode);
-		device_destroy(simtemp_class, devno); // Devno is MKDEV(simtemp_major, simtemp_minor)
+	fail_pdev:
+		platform_device_unregister(simtemp_pdev);
+		simtemp_pdev = NULL;
+
+	fail_driver:
+		platform_driver_unregister(&simtemp_driver);
 
 	fail_class:
 		class_destroy(simtemp_class);
 
+	fail_caches:
+		simtemp_caches_destroy();
+
 	fail_workqueue:
-		// Cancel any pending work and destroy the workqueue
-		cancel_delayed_work_sync(&simtemp_device.my_work_delay);
 		destroy_workqueue(my_workqueue);
 
-	fail_cdev:
-		cdev_del(&simtemp_device.cdev);
-
-	fail_kfifo:
-		kfifo_free(&simtemp_device.fifo); // free memory allocated for kfifo
-
 	fail_region:
 		// Only cleans up if alloc_chrdev_region succeeded
 		if (simtemp_major != 0)
-			unregister_chrdev_region(devno, 1);
+			unregister_chrdev_region(devno, SIMTEMP_NR_MINORS);
 		
 		return result; // Return the original error code
 
@@ -656,28 +2987,21 @@ static void __exit cleanup_function(void)
 {
 	dev_t devno = MKDEV(simtemp_major, simtemp_minor);
 
-	// Delete device and unregister major, minor
-	cdev_del(&simtemp_device.cdev);	
-	unregister_chrdev_region(devno, 1);
+	// Unbinding runs simtemp_remove(), which stops the producer
+	platform_device_unregister(simtemp_pdev);
+	platform_driver_unregister(&simtemp_driver);
 
-	// Wait to synchronize the queue
-	cancel_delayed_work_sync(&simtemp_device.my_work_delay);
-	// Destroy the workqueue	
+	// Nothing is queued any more
 	destroy_workqueue(my_workqueue);
-	
-	// Delete class, device, device file
-	// device_remove_file(simtemp_device_f, &dev_attr_simtemp);
-	device_remove_file(simtemp_device_f, &dev_attr_sampling_ms);
-	device_remove_file(simtemp_device_f, &dev_attr_threshold_mc);
-	device_remove_file(simtemp_device_f, &dev_attr_stats);	
-	device_remove_file(simtemp_device_f, &dev_attr_mode);
-	device_destroy(simtemp_class, devno);
-	class_unregister(simtemp_class);
+
+	// class_destroy() also unregisters it
 	class_destroy(simtemp_class);
-	
-	// Free kfifo
-    kfifo_free(&simtemp_device.fifo);
 
+	// Every mempool and open file is gone with the device
+	simtemp_caches_destroy();
+
+	// Unregister major, minors last
+	unregister_chrdev_region(devno, SIMTEMP_NR_MINORS);
 
 	printk(KERN_ALERT "EXIT TEST\n");
 }
@@ -686,3 +3010,8 @@ static void __exit cleanup_function(void)
 
 module_init(initialization_function);
 module_exit(cleanup_function);
+
+/* Driver KUnit suite, built in with CONFIG_SIMTEMP_KUNIT_TEST to reach the static paths */
+#ifdef SIMTEMP_KUNIT_DRIVER
+#include "nxp_simtemp_kunit.c"
+#endif
@@ -0,0 +1,125 @@
+/*
+ * kernel/nxp_simtemp.h
+ * Records and constants shared between the nxp_simtemp driver and userspace.
+ */
+
+#ifndef _NXP_SIMTEMP_H
+#define _NXP_SIMTEMP_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* flags */
+#define SIMTEMP_FLAG_NEW_SAMPLE        (1U << 0)	// 0b00000001
+#define SIMTEMP_FLAG_THRESHOLD_CROSSED (1U << 1)	// 0b00000010
+
+/* bits 8..15 of flags: channel id of the record (0 on single channel devices) */
+#define SIMTEMP_FLAG_CHANNEL_SHIFT     8
+#define SIMTEMP_FLAG_CHANNEL_MASK      (0xffU << SIMTEMP_FLAG_CHANNEL_SHIFT)
+#define SIMTEMP_FLAG_CHANNEL(flags)    (((flags) & SIMTEMP_FLAG_CHANNEL_MASK) >> SIMTEMP_FLAG_CHANNEL_SHIFT)
+
+#define SIMTEMP_MAX_CHANNELS           64
+
+/* bits 16..31 of flags (v2 records only): samples dropped by a full FIFO
+ * right before this record, saturates at 0xffff (use the seq gap beyond) */
+#define SIMTEMP_FLAG_DROPS_SHIFT       16
+#define SIMTEMP_FLAG_DROPS_MAX         0xffffU
+#define SIMTEMP_FLAG_DROPS_MASK        (SIMTEMP_FLAG_DROPS_MAX << SIMTEMP_FLAG_DROPS_SHIFT)
+#define SIMTEMP_FLAG_DROPS(flags)      (((flags) & SIMTEMP_FLAG_DROPS_MASK) >> SIMTEMP_FLAG_DROPS_SHIFT)
+
+/*
+ * Record read from /dev/simtemp0 (16 bytes)
+ */
+struct simtemp_sample {
+    __u64 timestamp_ns; // ktime_get_real_ns() 
+    __s32 temp_mC;      // milli-degrees Celsius
+    __u32 flags;        // bit0 NEW_SAMPLE, bit1 THRESHOLD, bits 8..15 channel
+} __attribute__((packed));
+
+/*
+ * Record read from /dev/simtemp0 after SIMTEMP_IOC_SET_RECORD_FORMAT(v2)
+ * (24 bytes). Starts with the v1 record, seq counts every produced sample
+ * (dropped ones included) so a jump in seq is a loss too.
+ */
+struct simtemp_sample_v2 {
+    __u64 timestamp_ns; // ktime_get_real_ns()
+    __s32 temp_mC;      // milli-degrees Celsius
+    __u32 flags;        // v1 flags, bits 16..31 drops since last record
+    __u64 seq;          // sequence number of the sample, from 0 at load
+} __attribute__((packed));
+
+/* record formats of /dev/simtemp0 */
+#define SIMTEMP_RECORD_V1 1	// struct simtemp_sample (default)
+#define SIMTEMP_RECORD_V2 2	// struct simtemp_sample_v2
+
+/*
+ * Record read from /dev/simtemp0_agg, one per channel and aggregation window
+ * (32 bytes). Every channel is aggregated on its own.
+ */
+struct simtemp_aggregate {
+    __u64 timestamp_ns; // timestamp of the last sample of the window
+    __s32 min_mC;       // minimum of the window
+    __s32 max_mC;       // maximum of the window
+    __s32 mean_mC;      // mean of the window
+    __u32 count;        // number of samples (producer passes) in the window
+    __u32 flags;        // bit0 NEW_SAMPLE, bit1 THRESHOLD (any sample crossed), bits 8..15 channel
+    __u32 reserved;
+} __attribute__((packed));
+
+/*
+ * History range query on /dev/simtemp0.
+ * Copies up to max_records samples with from_ns <= timestamp_ns <= to_ns
+ * (to_ns = 0 means up to the newest) from the in-kernel history ring, oldest
+ * first. When count == max_records, resume with from_ns = last timestamp + 1.
+ *
+ * The ring is ordered by CLOCK_MONOTONIC: from_ns and to_ns are wall clock
+ * times mapped onto it with the current realtime offset. After a clock step
+ * (settimeofday, NTP) the range follows the current clock, while the
+ * records keep the timestamp_ns they were produced with, so a resume across
+ * the step may repeat or skip records.
+ */
+struct simtemp_history_query {
+    __u64 from_ns;      // in: first timestamp (inclusive)
+    __u64 to_ns;        // in: last timestamp (inclusive), 0 = newest
+    __u64 records;      // in: user pointer to a struct simtemp_sample array
+    __u32 max_records;  // in: capacity of records
+    __u32 count;        // out: number of records copied
+    __u64 oldest_ns;    // out: oldest timestamp still held by the ring
+};
+
+/*
+ * Newest record of a channel without consuming it from the FIFO
+ * (SIMTEMP_IOC_GET_LATEST), never blocks. Fails with ENODATA before the
+ * first sample.
+ */
+struct simtemp_latest {
+    __u32 channel;      // in: channel id
+    __u32 reserved;
+    struct simtemp_sample_v2 sample;   // out: newest record, drop bits clear
+};
+
+/* ioctls */
+#define SIMTEMP_IOC_MAGIC   's'
+#define SIMTEMP_IOC_HISTORY _IOWR(SIMTEMP_IOC_MAGIC, 1, struct simtemp_history_query)
+/*
+ * Channels delivered to this open file, bit N = channel N (default: all).
+ * A file that leaves out some channel gets its own queue, fed by the
+ * producer with copies of its channels: it stops reading the shared FIFO,
+ * so other readers never lose records to its filter. Drops in its records
+ * and POLLERR then count losses of that queue. Bits of channels the device
+ * does not have are ignored; a mask selecting none of its channels fails
+ * with EINVAL.
+ */
+#define SIMTEMP_IOC_SET_CHANNEL_MASK _IOW(SIMTEMP_IOC_MAGIC, 2, __u64)
+#define SIMTEMP_IOC_GET_CHANNEL_MASK _IOR(SIMTEMP_IOC_MAGIC, 3, __u64)
+/* Record format returned by read() on this open file, SIMTEMP_RECORD_* */
+#define SIMTEMP_IOC_SET_RECORD_FORMAT _IOW(SIMTEMP_IOC_MAGIC, 4, __u32)
+#define SIMTEMP_IOC_GET_RECORD_FORMAT _IOR(SIMTEMP_IOC_MAGIC, 5, __u32)
+#define SIMTEMP_IOC_GET_LATEST _IOWR(SIMTEMP_IOC_MAGIC, 6, struct simtemp_latest)
+/*
+ * Eventfd signalled once per alert while this file stays open (-1 unbinds).
+ * poll() on the file itself reports POLLPRI once per new alert.
+ */
+#define SIMTEMP_IOC_SET_ALERT_EVENTFD _IOW(SIMTEMP_IOC_MAGIC, 7, __s32)
+
+#endif /* _NXP_SIMTEMP_H */
@@ -0,0 +1,434 @@
+/*
+ * kernel/nxp_simtemp_kunit.c
+ * KUnit suite of the nxp_simtemp driver paths.
+ *
+ * Not built on its own: nxp_simtemp.c includes it at its end when the
+ * Makefile defines SIMTEMP_KUNIT_DRIVER (CONFIG_SIMTEMP_KUNIT_TEST), so
+ * the cases call the driver's static functions. Unlike simtemp_kunit.c,
+ * which tests the core helpers with stand-ins, these run the real
+ * simtemp_fifo_push(), simtemp_sample_enqueue() with its subscriber
+ * fan-out, simtemp_read_records() and simtemp_produce_sample() on a test
+ * simtemp_dev that is never registered: no cdev, no producer, no sysfs.
+ */
+
+#include <kunit/test.h>
+
+#define TEST_CHANNELS 4				// Channels of the test device
+#define TEST_FIFO_PASSES 16			// Producer passes of the test FIFO (rounded up by kfifo)
+#define TEST_WRITER_PASSES 20000	// Producer passes of the config writer case
+#define TEST_WRITER_SPAN 1024		// Values the config writer cycles through
+
+static bool simtemp_ktest_own_caches;	// The suite created the slab caches
+
+/* Records the FIFO of the test device holds */
+static unsigned int simtemp_ktest_cap(struct simtemp_dev *dev)
+{
+	return kfifo_size(&dev->fifo) / sizeof(struct simtemp_sample_v2);
+}
+
+/* A file of the test device, as simtemp_open() sets it up */
+static struct simtemp_reader *simtemp_ktest_reader(struct kunit *test, struct simtemp_dev *dev)
+{
+	struct simtemp_reader *reader;
+
+	reader = kunit_kzalloc(test, sizeof(*reader), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, reader);
+	reader->dev = dev;
+	reader->channel_mask = U64_MAX;
+	reader->format = SIMTEMP_RECORD_V2;
+	INIT_LIST_HEAD(&reader->alert_node);
+	INIT_LIST_HEAD(&reader->sub_node);
+
+	return reader;
+}
+
+/* One producer pass through simtemp_sample_enqueue(), returns what it returns */
+static int simtemp_ktest_pass(struct simtemp_dev *dev, const struct simtemp_config *cfg)
+{
+	struct simtemp_sample_v2 rec[SIMTEMP_MAX_CHANNELS];
+	s32 temps[SIMTEMP_MAX_CHANNELS];
+	bool alert;
+
+	generate_temperature_batch(dev, cfg, temps, dev->channels);
+	alert = simtemp_core_records(rec, temps, dev->channels, ktime_get_real_ns(),
+				     cfg->threshold_mc, &dev->next_seq);
+
+	return simtemp_sample_enqueue(dev, cfg, rec, dev->channels, alert);
+}
+
+/* read() of up to n records of rec_size bytes into buf */
+static ssize_t simtemp_ktest_read(struct simtemp_reader *reader, void *buf, unsigned int n, size_t rec_size)
+{
+	struct kvec kvec = { .iov_base = buf, .iov_len = n * rec_size };
+	struct iov_iter iter;
+
+	iov_iter_kvec(&iter, ITER_DEST, &kvec, 1, kvec.iov_len);
+
+	return simtemp_read_records(reader, &iter, rec_size, false);
+}
+
+/*
+ * Read every record of the shared FIFO: seq increases and every gap is
+ * reported by the drop count of the record after it. Returns the records
+ */
+static unsigned int simtemp_ktest_drain(struct kunit *test, struct simtemp_reader *reader, u64 *expect)
+{
+	struct simtemp_sample_v2 out[16];
+	unsigned int total = 0, i, n;
+	ssize_t ret;
+	u64 gap;
+
+	while ((ret = simtemp_ktest_read(reader, out, ARRAY_SIZE(out), sizeof(out[0]))) > 0) {
+		n = ret / sizeof(out[0]);
+		for (i = 0; i < n; i++) {
+			KUNIT_EXPECT_GE(test, out[i].seq, *expect);
+			gap = out[i].seq >= *expect ? out[i].seq - *expect : 0;
+			KUNIT_EXPECT_EQ(test, (u64)SIMTEMP_FLAG_DROPS(out[i].flags),
+					min_t(u64, gap, SIMTEMP_FLAG_DROPS_MAX));
+			*expect = out[i].seq + 1;
+		}
+		total += n;
+	}
+	KUNIT_EXPECT_EQ(test, ret, 0);
+
+	return total;
+}
+
+/* ---------------------------------------------------------------------------
+ * Enqueue and read
+ */
+
+/* Drop newest: a full FIFO keeps its records, the next admitted one reports the rest */
+static void simtemp_ktest_drop_newest(struct kunit *test)
+{
+	struct simtemp_dev *dev = test->priv;
+	struct simtemp_reader *reader = simtemp_ktest_reader(test, dev);
+	struct simtemp_config cfg;
+	unsigned int cap = simtemp_ktest_cap(dev), pass, passes;
+	u64 expect = 0;
+	int ret;
+
+	simtemp_config_get(dev, &cfg);
+	passes = DIV_ROUND_UP(cap, TEST_CHANNELS);
+	for (pass = 0; pass < passes; pass++) {
+		ret = simtemp_ktest_pass(dev, &cfg);
+		KUNIT_EXPECT_GT(test, ret, 0);
+	}
+
+	// Full: nothing more goes in and every record of the pass is counted
+	KUNIT_EXPECT_EQ(test, simtemp_ktest_pass(dev, &cfg), -ENOSPC);
+	KUNIT_EXPECT_EQ(test, kfifo_len(&dev->fifo) / sizeof(struct simtemp_sample_v2), cap);
+	KUNIT_EXPECT_EQ(test, simtemp_core_lost(&dev->drops), (u64)(passes + 1) * TEST_CHANNELS - cap);
+
+	// The queued ones come out untouched, the first record after them reports the loss
+	KUNIT_EXPECT_EQ(test, simtemp_ktest_drain(test, reader, &expect), cap);
+	KUNIT_EXPECT_EQ(test, expect, (u64)cap);
+	KUNIT_EXPECT_EQ(test, simtemp_ktest_pass(dev, &cfg), TEST_CHANNELS);
+	KUNIT_EXPECT_EQ(test, simtemp_ktest_drain(test, reader, &expect), TEST_CHANNELS);
+	KUNIT_EXPECT_EQ(test, reader->lost_seen, simtemp_core_lost(&dev->drops));
+}
+
+/*
+ * Overwrite oldest against a FIFO that already queues a record carrying
+ * drop-newest losses: discarding it must not lose what it reported
+ */
+static void simtemp_ktest_overwrite(struct kunit *test)
+{
+	struct simtemp_dev *dev = test->priv;
+	struct simtemp_reader *reader = simtemp_ktest_reader(test, dev);
+	struct simtemp_sample_v2 out[TEST_CHANNELS];
+	struct simtemp_config cfg;
+	unsigned int cap = simtemp_ktest_cap(dev), pass;
+	u64 expect = 0;
+
+	simtemp_config_get(dev, &cfg);
+
+	// Overflow, make some room and queue a record reporting the loss
+	for (pass = 0; pass <= cap / TEST_CHANNELS; pass++)
+		simtemp_ktest_pass(dev, &cfg);
+	KUNIT_ASSERT_EQ(test, simtemp_ktest_read(reader, out, TEST_CHANNELS, sizeof(out[0])),
+			(ssize_t)sizeof(out));
+	expect = out[TEST_CHANNELS - 1].seq + 1;
+	KUNIT_EXPECT_GT(test, simtemp_ktest_pass(dev, &cfg), 0);
+	KUNIT_EXPECT_EQ(test, dev->drops.pending, 0U);
+
+	// Overwrite past every queued record, the carrier included
+	cfg.overflow = OVERFLOW_OVERWRITE_OLDEST;
+	for (pass = 0; pass <= cap / TEST_CHANNELS + 1; pass++)
+		KUNIT_EXPECT_EQ(test, simtemp_ktest_pass(dev, &cfg), TEST_CHANNELS);
+	KUNIT_EXPECT_GT(test, dev->drops.overwritten, 0ULL);
+	KUNIT_EXPECT_EQ(test, kfifo_len(&dev->fifo) / sizeof(struct simtemp_sample_v2), cap);
+
+	// Every gap, overwritten or dropped, is reported exactly
+	KUNIT_EXPECT_EQ(test, simtemp_ktest_drain(test, reader, &expect), cap);
+	KUNIT_EXPECT_EQ(test, expect, dev->next_seq);
+}
+
+/* A filtered file gets only its channels, in its own queue with its own losses */
+static void simtemp_ktest_fanout(struct kunit *test)
+{
+	struct simtemp_dev *dev = test->priv;
+	struct simtemp_reader *shared = simtemp_ktest_reader(test, dev);
+	struct simtemp_reader *filtered = simtemp_ktest_reader(test, dev);
+	struct simtemp_sample_v2 out[2 * TEST_CHANNELS];
+	struct simtemp_config cfg;
+	u64 mask = BIT_ULL(1) | BIT_ULL(3), expect = 0, next = 0;
+	unsigned int cap = simtemp_ktest_cap(dev), pass, passes, i, n;
+	ssize_t ret;
+
+	simtemp_config_get(dev, &cfg);
+
+	// Masks selecting no existing channel are refused
+	KUNIT_EXPECT_EQ(test, simtemp_reader_set_mask(filtered, 0), -EINVAL);
+	KUNIT_EXPECT_EQ(test, simtemp_reader_set_mask(filtered, BIT_ULL(TEST_CHANNELS + 6)), -EINVAL);
+	KUNIT_EXPECT_FALSE(test, filtered->subscribed);
+
+	KUNIT_ASSERT_EQ(test, simtemp_reader_set_mask(filtered, mask), 0);
+	KUNIT_EXPECT_TRUE(test, filtered->subscribed);
+
+	for (pass = 0; pass < 2; pass++)
+		KUNIT_EXPECT_EQ(test, simtemp_ktest_pass(dev, &cfg), TEST_CHANNELS);
+
+	ret = simtemp_ktest_read(filtered, out, ARRAY_SIZE(out), sizeof(out[0]));
+	KUNIT_EXPECT_EQ(test, ret, (ssize_t)(2 * hweight64(mask) * sizeof(out[0])));
+	n = ret > 0 ? ret / sizeof(out[0]) : 0;
+	for (i = 0; i < n; i++) {
+		KUNIT_EXPECT_TRUE(test, mask & BIT_ULL(SIMTEMP_FLAG_CHANNEL(out[i].flags)));
+		KUNIT_EXPECT_GE(test, out[i].seq, next);
+		KUNIT_EXPECT_EQ(test, SIMTEMP_FLAG_DROPS(out[i].flags), 0U);
+		next = out[i].seq + 1;
+	}
+	KUNIT_EXPECT_EQ(test, simtemp_ktest_drain(test, shared, &expect), 2 * TEST_CHANNELS);
+
+	// Overflow only the filtered queue, the shared one is drained every pass
+	passes = cap / hweight64(mask) + 2;
+	for (pass = 0; pass < passes; pass++) {
+		KUNIT_EXPECT_EQ(test, simtemp_ktest_pass(dev, &cfg), TEST_CHANNELS);
+		simtemp_ktest_drain(test, shared, &expect);
+	}
+	KUNIT_EXPECT_EQ(test, simtemp_core_lost(&dev->drops), 0ULL);
+	KUNIT_EXPECT_EQ(test, simtemp_core_lost(&filtered->drops), (u64)passes * hweight64(mask) - cap);
+
+	// The full mask moves the file back to the shared FIFO
+	KUNIT_EXPECT_EQ(test, simtemp_reader_set_mask(filtered, U64_MAX), 0);
+	KUNIT_EXPECT_FALSE(test, filtered->subscribed);
+	KUNIT_EXPECT_TRUE(test, list_empty(&dev->subscribers));
+	kfifo_free(&filtered->fifo);
+}
+
+/* v1 reads drop the drop count, only whole records are copied */
+static void simtemp_ktest_read_v1(struct kunit *test)
+{
+	struct simtemp_dev *dev = test->priv;
+	struct simtemp_reader *reader = simtemp_ktest_reader(test, dev);
+	struct simtemp_sample out[TEST_CHANNELS];
+	struct simtemp_config cfg;
+	unsigned int cap = simtemp_ktest_cap(dev), pass, i;
+	u64 expect = 0;
+
+	simtemp_config_get(dev, &cfg);
+	KUNIT_EXPECT_EQ(test, simtemp_ktest_read(reader, out, 1, sizeof(out[0])), 0);
+
+	// Overflow, so the next admitted record carries drop bits
+	for (pass = 0; pass <= cap / TEST_CHANNELS; pass++)
+		simtemp_ktest_pass(dev, &cfg);
+	while (simtemp_ktest_read(reader, out, ARRAY_SIZE(out), sizeof(out[0])) > 0)
+		;
+	KUNIT_EXPECT_EQ(test, simtemp_ktest_pass(dev, &cfg), TEST_CHANNELS);
+
+	KUNIT_EXPECT_EQ(test, simtemp_ktest_read(reader, out, 1, sizeof(out[0])), (ssize_t)sizeof(out[0]));
+	KUNIT_EXPECT_EQ(test, out[0].flags & SIMTEMP_FLAG_DROPS_MASK, 0U);
+	KUNIT_EXPECT_EQ(test, SIMTEMP_FLAG_CHANNEL(out[0].flags), 0U);
+
+	KUNIT_EXPECT_EQ(test, simtemp_ktest_read(reader, out, ARRAY_SIZE(out), sizeof(out[0])),
+			(ssize_t)((TEST_CHANNELS - 1) * sizeof(out[0])));
+	for (i = 0; i < TEST_CHANNELS - 1; i++) {
+		KUNIT_EXPECT_EQ(test, SIMTEMP_FLAG_CHANNEL(out[i].flags), i + 1);
+		KUNIT_EXPECT_EQ(test, out[i].temp_mC, BASE_TEMP_mC + (s32)(i + 1) * CHANNEL_SPREAD_mC);
+	}
+	KUNIT_EXPECT_EQ(test, simtemp_ktest_drain(test, reader, &expect), 0U);
+}
+
+/* ---------------------------------------------------------------------------
+ * Concurrency
+ */
+
+/*
+ * Stores like the sysfs attributes do, every field derived from the same
+ * k, so a torn snapshot shows up as fields that disagree
+ */
+static int simtemp_ktest_cfg_writer(void *data)
+{
+	struct simtemp_dev *dev = data;
+	unsigned int k = 0;
+
+	while (!kthread_should_stop()) {
+		k = (k + 1) % TEST_WRITER_SPAN;
+		write_seqlock(&dev->cfg_lock);
+		dev->cfg.threshold_mc = BASE_TEMP_mC + k;
+		dev->cfg.sampling_us = MIN_SAMPLING_US + k;
+		dev->cfg.noise_mc = k;
+		dev->cfg.mode = k & 1 ? MODE_RAMP : MODE_NORMAL;
+		write_sequnlock(&dev->cfg_lock);
+		cond_resched();
+	}
+
+	return 0;
+}
+
+/*
+ * A config writer thread against the producer pass: every snapshot the
+ * producer takes is consistent, and the threshold flag of every published
+ * record matches the threshold of the snapshot that produced it
+ */
+static void simtemp_ktest_config_writer(struct kunit *test)
+{
+	struct simtemp_dev *dev = test->priv;
+	struct simtemp_reader *reader = simtemp_ktest_reader(test, dev);
+	struct simtemp_sample_v2 rec;
+	struct simtemp_config cfg;
+	struct task_struct *task;
+	unsigned int pass, ch, torn = 0, wrong = 0, changes = 0;
+	int alerts = 0, last = -1;
+	u64 expect = 0;
+	bool alert;
+
+	// Start from a configuration the writer could have stored (k = 0)
+	dev->cfg.threshold_mc = BASE_TEMP_mC;
+	dev->cfg.sampling_us = MIN_SAMPLING_US;
+	dev->cfg.noise_mc = 0;
+	dev->cfg.mode = MODE_NORMAL;
+
+	task = kthread_run(simtemp_ktest_cfg_writer, dev, "simtemp_ktest");
+	KUNIT_ASSERT_FALSE(test, IS_ERR(task));
+
+	for (pass = 0; pass < TEST_WRITER_PASSES; pass++) {
+		simtemp_config_get(dev, &cfg);
+		if (cfg.sampling_us - MIN_SAMPLING_US != cfg.noise_mc ||
+		    cfg.threshold_mc - BASE_TEMP_mC != cfg.noise_mc ||
+		    cfg.mode != (cfg.noise_mc & 1 ? MODE_RAMP : MODE_NORMAL))
+			torn++;
+		changes += cfg.noise_mc != last;
+		last = cfg.noise_mc;
+
+		simtemp_produce_sample(dev, &cfg);
+
+		alert = false;
+		for (ch = 0; ch < dev->channels; ch++) {
+			KUNIT_ASSERT_EQ(test, simtemp_latest_get(dev, ch, &rec), 0);
+			if (!!(rec.flags & SIMTEMP_FLAG_THRESHOLD_CROSSED) != (rec.temp_mC > cfg.threshold_mc))
+				wrong++;
+			alert |= !!(rec.flags & SIMTEMP_FLAG_THRESHOLD_CROSSED);
+		}
+		alerts += alert;
+
+		if (!(pass % TEST_FIFO_PASSES)) {
+			simtemp_ktest_drain(test, reader, &expect);
+			cond_resched();
+		}
+	}
+	kthread_stop(task);
+	simtemp_ktest_drain(test, reader, &expect);
+
+	KUNIT_EXPECT_EQ(test, torn, 0U);
+	KUNIT_EXPECT_EQ(test, wrong, 0U);
+	KUNIT_EXPECT_EQ(test, dev->count_alerts, alerts);
+	KUNIT_EXPECT_EQ(test, dev->samples_taken, (unsigned long)TEST_WRITER_PASSES * TEST_CHANNELS);
+	KUNIT_EXPECT_EQ(test, expect, dev->next_seq);
+	kunit_info(test, "%u config changes seen in %u passes\n", changes, TEST_WRITER_PASSES);
+}
+
+/* ---------------------------------------------------------------------------
+ * Suite
+ */
+
+/*
+ * The readers' slab caches come from module init; create them when the
+ * suite runs first, and only destroy what it created
+ */
+static int simtemp_ktest_suite_init(struct kunit_suite *suite)
+{
+	if (simtemp_reader_cache)
+		return 0;
+
+	simtemp_ktest_own_caches = true;
+	return simtemp_caches_create();
+}
+
+static void simtemp_ktest_suite_exit(struct kunit_suite *suite)
+{
+	if (simtemp_ktest_own_caches)
+		simtemp_caches_destroy();
+	simtemp_ktest_own_caches = false;
+}
+
+/* A simtemp_dev as simtemp_probe() sets it up, without registering anything */
+static int simtemp_ktest_init(struct kunit *test)
+{
+	struct simtemp_dev *dev;
+	int ret;
+
+	dev = kunit_kzalloc(test, sizeof(*dev), GFP_KERNEL);
+	if (!dev)
+		return -ENOMEM;
+	sema_init(&dev->sem, 1);
+	mutex_init(&dev->update_lock);
+	seqlock_init(&dev->cfg_lock);
+	spin_lock_init(&dev->state_lock);
+	spin_lock_init(&dev->history_lock);
+	spin_lock_init(&dev->fifo_lock);
+	seqcount_init(&dev->latest_seq);
+	init_waitqueue_head(&dev->read_alert_wq);
+	init_waitqueue_head(&dev->agg_wq);
+	INIT_LIST_HEAD(&dev->alert_readers);
+	INIT_LIST_HEAD(&dev->subscribers);
+	dev->channels = TEST_CHANNELS;
+	dev->producer_cpu = -1;
+	dev->cfg = (struct simtemp_config){
+		.sampling_ms = DEFAULT_SAMPLING_MS,
+		.sampling_us = DEFAULT_SAMPLING_MS * USEC_PER_MSEC,
+		.threshold_mc = DEFAULT_THRESHOLD_mC,
+		.mode = MODE_NORMAL,
+		.noise_mc = NOISE_SPAN_mC,
+		.overflow = OVERFLOW_DROP_NEWEST,
+	};
+	simtemp_gen_seed(&dev->gen, dev->cfg.seed);
+	test->priv = dev;
+
+	ret = kfifo_alloc(&dev->fifo, TEST_FIFO_PASSES * TEST_CHANNELS * sizeof(struct simtemp_sample_v2),
+			  GFP_KERNEL);
+	if (ret)
+		return ret;
+
+	return simtemp_pools_create(dev);
+}
+
+static void simtemp_ktest_exit(struct kunit *test)
+{
+	struct simtemp_dev *dev = test->priv;
+
+	// Also runs after a failed init, both undo partial setups
+	if (dev) {
+		simtemp_pools_destroy(dev);
+		kfifo_free(&dev->fifo);
+	}
+}
+
+static struct kunit_case simtemp_ktest_cases[] = {
+	KUNIT_CASE(simtemp_ktest_drop_newest),
+	KUNIT_CASE(simtemp_ktest_overwrite),
+	KUNIT_CASE(simtemp_ktest_fanout),
+	KUNIT_CASE(simtemp_ktest_read_v1),
+	KUNIT_CASE(simtemp_ktest_config_writer),
+	{}
+};
+
+static struct kunit_suite simtemp_ktest_suite = {
+	.name = "simtemp_driver",
+	.suite_init = simtemp_ktest_suite_init,
+	.suite_exit = simtemp_ktest_suite_exit,
+	.init = simtemp_ktest_init,
+	.exit = simtemp_ktest_exit,
+	.test_cases = simtemp_ktest_cases,
+};
+kunit_test_suite(simtemp_ktest_suite);
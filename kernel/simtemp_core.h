@@ -0,0 +1,249 @@
+/*
+ * kernel/simtemp_core.h
+ * Data path logic of the nxp_simtemp driver that does not need the kernel.
+ *
+ * Header only, like simtemp_gen.h: the driver wraps these helpers with its
+ * kfifo, locks, wait queues and copy_to_user(), user/bench builds them in
+ * userspace for benchmarks, perf and sanitizers. Nothing here sleeps,
+ * locks or allocates; callers provide the serialization.
+ */
+
+#ifndef _SIMTEMP_CORE_H
+#define _SIMTEMP_CORE_H
+
+#include "nxp_simtemp.h"
+#include "simtemp_gen.h"
+
+#ifdef __KERNEL__
+#include <linux/math64.h>
+#else
+#include <stdbool.h>
+typedef int64_t s64;
+
+static inline s64 div_s64(s64 dividend, s32 divisor)
+{
+	return dividend / divisor;
+}
+#endif
+
+/* Loss accounting of the sample FIFO */
+struct simtemp_core_drops {
+	u32 pending;					// Newest samples dropped, not yet reported in a record
+	u32 head_lost;					// Oldest records overwritten ahead of the FIFO head
+	u64 total;						// Every newest sample dropped so far
+	u64 overwritten;				// Every oldest record overwritten so far
+};
+
+/* Saturating add of a drop count */
+static inline u32 simtemp_core_drops_add(u32 a, u64 b)
+{
+	return a + b < 0xffffffffULL ? (u32)(a + b) : 0xffffffffU;
+}
+
+/* Set the drops of a record to its own plus lost (saturating at the flag width) */
+static inline void simtemp_core_flag_drops(struct simtemp_sample_v2 *rec, u32 lost)
+{
+	u32 drops = simtemp_core_drops_add(SIMTEMP_FLAG_DROPS(rec->flags), lost);
+
+	if (drops > SIMTEMP_FLAG_DROPS_MAX)
+		drops = SIMTEMP_FLAG_DROPS_MAX;
+	rec->flags = (rec->flags & ~SIMTEMP_FLAG_DROPS_MASK) | (drops << SIMTEMP_FLAG_DROPS_SHIFT);
+}
+
+/* Running aggregate of the current window */
+struct simtemp_core_agg {
+	s32 min_mC;
+	s32 max_mC;
+	s64 sum_mC;
+	u32 count;
+	u32 flags;
+	s64 window_start_ns;			// Monotonic time of the first sample
+};
+
+/* Flags of a fresh sample (the threshold flag replaces NEW_SAMPLE) */
+static inline u32 simtemp_core_flags(s32 temp_mC, s32 threshold_mC, unsigned int ch)
+{
+	u32 flags = temp_mC > threshold_mC ? SIMTEMP_FLAG_THRESHOLD_CROSSED : SIMTEMP_FLAG_NEW_SAMPLE;
+
+	return flags | (ch << SIMTEMP_FLAG_CHANNEL_SHIFT);
+}
+
+/*
+ * Turn the temperatures of one pass into records sharing timestamp_ns,
+ * numbering them from *next_seq. Returns true if any crossed the threshold.
+ */
+static inline bool simtemp_core_records(struct simtemp_sample_v2 *rec, const s32 *temps, unsigned int n,
+					u64 timestamp_ns, s32 threshold_mC, u64 *next_seq)
+{
+	bool alert = false;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		rec[i].timestamp_ns = timestamp_ns;
+		rec[i].temp_mC = temps[i];
+		rec[i].flags = simtemp_core_flags(temps[i], threshold_mC, i);
+		rec[i].seq = (*next_seq)++;
+		alert |= !!(rec[i].flags & SIMTEMP_FLAG_THRESHOLD_CROSSED);
+	}
+
+	return alert;
+}
+
+/*
+ * How many of the n records fit in room free slots (the rest is dropped).
+ * The first admitted record reports the drops that happened before it.
+ */
+static inline unsigned int simtemp_core_admit(struct simtemp_core_drops *d, struct simtemp_sample_v2 *rec,
+					      unsigned int n, unsigned int room)
+{
+	unsigned int pushed = n < room ? n : room;
+
+	if (pushed && d->pending) {
+		simtemp_core_flag_drops(&rec[0], d->pending);
+		d->pending = 0;
+	}
+	if (pushed < n) {
+		d->pending = simtemp_core_drops_add(d->pending, n - pushed);
+		d->total += n - pushed;
+	}
+
+	return pushed;
+}
+
+/*
+ * Overwrite-oldest policy: how many of the used queued records to discard
+ * so that n new ones fit in room. They are reported by the next record
+ * popped (simtemp_core_pop), which is the oldest survivor.
+ */
+static inline unsigned int simtemp_core_overwrite(struct simtemp_core_drops *d, unsigned int n,
+						  unsigned int room, unsigned int used)
+{
+	unsigned int discard = n > room ? n - room : 0;
+
+	if (discard > used)
+		discard = used;
+	d->head_lost = simtemp_core_drops_add(d->head_lost, discard);
+	d->overwritten += discard;
+
+	return discard;
+}
+
+/*
+ * A queued record discarded by simtemp_core_overwrite(): the drops it was
+ * carrying are passed on with it, so the next record popped reports them
+ */
+static inline void simtemp_core_discard(struct simtemp_core_drops *d, const struct simtemp_sample_v2 *rec)
+{
+	d->head_lost = simtemp_core_drops_add(d->head_lost, SIMTEMP_FLAG_DROPS(rec->flags));
+}
+
+/* A record leaves the FIFO: hand it the overwrites that happened ahead of it */
+static inline void simtemp_core_pop(struct simtemp_core_drops *d, struct simtemp_sample_v2 *rec)
+{
+	if (d->head_lost) {
+		simtemp_core_flag_drops(rec, d->head_lost);
+		d->head_lost = 0;
+	}
+}
+
+/* Every sample lost so far, whatever the policy */
+static inline u64 simtemp_core_lost(const struct simtemp_core_drops *d)
+{
+	return d->total + d->overwritten;
+}
+
+/*
+ * Records of one pass for the own queue of a reader with channel_mask: the
+ * matching ones are copied to out with their drop bits cleared, since that
+ * queue accounts its own drops (simtemp_core_admit). Returns how many.
+ */
+static inline unsigned int simtemp_core_deliver(const struct simtemp_sample_v2 *rec, unsigned int n,
+						u64 channel_mask, struct simtemp_sample_v2 *out)
+{
+	unsigned int i, ch, m = 0;
+
+	for (i = 0; i < n; i++) {
+		ch = SIMTEMP_FLAG_CHANNEL(rec[i].flags);
+		if (ch >= SIMTEMP_MAX_CHANNELS || !(channel_mask & (1ULL << ch)))
+			continue;
+		out[m] = rec[i];
+		out[m].flags &= ~SIMTEMP_FLAG_DROPS_MASK;
+		m++;
+	}
+
+	return m;
+}
+
+/*
+ * Fold a sample into the current window of its channel. When the window
+ * closes (agg_samples samples or agg_window_ms elapsed) fill *out, tagged
+ * with the channel of rec, and return true.
+ */
+static inline bool simtemp_core_agg_add(struct simtemp_core_agg *agg, const struct simtemp_sample_v2 *rec,
+					s64 now_ns, u32 agg_samples, u32 agg_window_ms,
+					struct simtemp_aggregate *out)
+{
+	// First sample opens a new window
+	if (agg->count == 0) {
+		agg->min_mC = rec->temp_mC;
+		agg->max_mC = rec->temp_mC;
+		agg->sum_mC = 0;
+		agg->flags = 0;
+		agg->window_start_ns = now_ns;
+	}
+
+	if (rec->temp_mC < agg->min_mC)
+		agg->min_mC = rec->temp_mC;
+	if (rec->temp_mC > agg->max_mC)
+		agg->max_mC = rec->temp_mC;
+	agg->sum_mC += rec->temp_mC;
+	agg->count++;
+	agg->flags |= rec->flags & SIMTEMP_FLAG_THRESHOLD_CROSSED;
+
+	if (!(agg_samples && agg->count >= agg_samples) &&
+	    !(agg_window_ms && now_ns - agg->window_start_ns >= (s64)agg_window_ms * 1000000))
+		return false;
+
+	out->timestamp_ns = rec->timestamp_ns;
+	out->min_mC = agg->min_mC;
+	out->max_mC = agg->max_mC;
+	out->mean_mC = div_s64(agg->sum_mC, agg->count);
+	out->count = agg->count;
+	out->flags = SIMTEMP_FLAG_NEW_SAMPLE | agg->flags | (rec->flags & SIMTEMP_FLAG_CHANNEL_MASK);
+	out->reserved = 0;
+	agg->count = 0;
+
+	return true;
+}
+
+/*
+ * History ring slot. Records carry wall clock timestamps, which step back
+ * and forth with settimeofday() and NTP, so the ring is ordered by the
+ * CLOCK_MONOTONIC time of the pass instead.
+ */
+struct simtemp_core_hist {
+	u64 mono_ns;					// Monotonic time the record was produced
+	struct simtemp_sample rec;		// v1 record, drop bits clear
+};
+
+/*
+ * First position in [lo, hi) of a history ring (mask = size - 1) with
+ * mono_ns >= from_ns. Slots are appended in monotonic order.
+ */
+static inline u64 simtemp_core_history_find(const struct simtemp_core_hist *ring, u32 mask,
+					    u64 lo, u64 hi, u64 from_ns)
+{
+	u64 mid;
+
+	while (lo < hi) {
+		mid = lo + ((hi - lo) >> 1);
+		if (ring[mid & mask].mono_ns < from_ns)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+#endif /* _SIMTEMP_CORE_H */
@@ -0,0 +1,195 @@
+/*
+ * kernel/simtemp_gen.h
+ * Temperature generator of the nxp_simtemp driver.
+ *
+ * Kernel agnostic and header only: the driver includes it for the producer
+ * and user/bench builds the very same code in userspace. Everything is
+ * integer arithmetic (no kernel_fpu_begin needed) and the noise comes from
+ * SIMTEMP_GEN_LANES independent xorshift32 generators stepped side by side,
+ * a loop shape compilers turn into integer SIMD where it is allowed.
+ */
+
+#ifndef _SIMTEMP_GEN_H
+#define _SIMTEMP_GEN_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+typedef uint32_t u32;
+typedef int32_t s32;
+typedef uint64_t u64;
+#endif
+
+#define SIMTEMP_GEN_LANES 8			// Independent PRNG lanes
+
+/* generator modes (same values as the driver's sensor modes) */
+#define SIMTEMP_GEN_NORMAL 0		// Constant base temperature
+#define SIMTEMP_GEN_NOISY  1		// Base + noise (uniform or gaussian)
+#define SIMTEMP_GEN_RAMP   2		// Base + ramp_step per sample
+#define SIMTEMP_GEN_SINE   3		// Base + fixed-point sine wave
+
+/* noise distributions, both cover [0, noise_mC) */
+#define SIMTEMP_GEN_DIST_UNIFORM  0	// Flat
+#define SIMTEMP_GEN_DIST_GAUSSIAN 1	// Sum of 4 uniforms (Irwin-Hall), sigma ~ 0.14 * noise_mC
+
+#define SIMTEMP_GEN_MAX_NOISE_mC 65535	// Largest noise span (16-bit fixed point)
+
+#define SIMTEMP_GEN_SINE_STEP 64	// Phase step per sample (Q16 turn, 1024 samples per period)
+
+struct simtemp_gen_params {
+	int mode;						// SIMTEMP_GEN_*
+	s32 base_mC;					// Base temperature
+	s32 spread_mC;					// Offset between consecutive channels
+	u32 noise_mC;					// Noise span, values in [0, noise_mC), <= SIMTEMP_GEN_MAX_NOISE_mC
+	int dist;						// SIMTEMP_GEN_DIST_*
+	s32 ramp_step_mC;				// Ramp increment per sample
+	s32 amplitude_mC;				// Sine amplitude
+};
+
+struct simtemp_gen_state {
+	u32 lane[SIMTEMP_GEN_LANES];	// xorshift32 states, never 0
+	s32 ramp_mC;					// Ramp offset reached so far
+	u32 phase;						// Sine phase (Q16 turn)
+};
+
+/* Seed the lanes from one 32-bit seed (splitmix-style spread, no zero state) */
+static inline void simtemp_gen_seed(struct simtemp_gen_state *st, u32 seed)
+{
+	unsigned int l;
+	u32 z;
+
+	for (l = 0; l < SIMTEMP_GEN_LANES; l++) {
+		z = seed + (l + 1) * 0x9e3779b9U;
+		z = (z ^ (z >> 16)) * 0x85ebca6bU;
+		z = (z ^ (z >> 13)) * 0xc2b2ae35U;
+		z ^= z >> 16;
+		st->lane[l] = z ? z : 0x6d2b79f5U;
+	}
+	st->ramp_mC = 0;
+	st->phase = 0;
+}
+
+/* One xorshift32 step of every lane */
+static inline void simtemp_gen_step(u32 *x)
+{
+	unsigned int l;
+
+	for (l = 0; l < SIMTEMP_GEN_LANES; l++) {
+		x[l] ^= x[l] << 13;
+		x[l] ^= x[l] >> 17;
+		x[l] ^= x[l] << 5;
+	}
+}
+
+/*
+ * Fill out[0..n) with base + noise in [0, span) of the given distribution,
+ * SIMTEMP_GEN_LANES at a time
+ */
+static inline void simtemp_gen_noise(struct simtemp_gen_state *st, s32 *out, unsigned int n,
+				     s32 base_mC, s32 spread_mC, u32 span, int dist)
+{
+	u32 x[SIMTEMP_GEN_LANES], y[SIMTEMP_GEN_LANES], u;
+	unsigned int i, l;
+
+	for (l = 0; l < SIMTEMP_GEN_LANES; l++)
+		x[l] = st->lane[l];
+
+	for (i = 0; i < n; i += SIMTEMP_GEN_LANES) {
+		simtemp_gen_step(x);
+		if (dist == SIMTEMP_GEN_DIST_GAUSSIAN) {
+			// Four 16-bit uniforms from two steps, their mean is bell shaped
+			for (l = 0; l < SIMTEMP_GEN_LANES; l++)
+				y[l] = x[l];
+			simtemp_gen_step(x);
+			for (l = 0; l < SIMTEMP_GEN_LANES && i + l < n; l++) {
+				u = ((y[l] >> 16) + (y[l] & 0xffff) + (x[l] >> 16) + (x[l] & 0xffff)) >> 2;
+				out[i + l] = base_mC + (s32)(i + l) * spread_mC + (s32)((u * span) >> 16);
+			}
+		} else {
+			// Multiply-shift instead of modulo: maps the top 16 bits onto [0, span)
+			for (l = 0; l < SIMTEMP_GEN_LANES && i + l < n; l++)
+				out[i + l] = base_mC + (s32)(i + l) * spread_mC + (s32)(((x[l] >> 16) * span) >> 16);
+		}
+	}
+
+	for (l = 0; l < SIMTEMP_GEN_LANES; l++)
+		st->lane[l] = x[l];
+}
+
+/* Fixed-point sine of a Q16 phase, Q15 result (parabolic approximation, < 6 % error) */
+static inline s32 simtemp_gen_sine_q15(u32 phase)
+{
+	s32 half = phase & 0x7fff;
+	s32 y = (half * (32768 - half)) >> 13;
+
+	return (phase & 0x8000) ? -y : y;
+}
+
+/*
+ * One sampling period of n channels: the time dependent part (ramp, sine)
+ * advances once and is shared, the noise is independent per channel.
+ */
+static inline void simtemp_gen_channels(struct simtemp_gen_state *st, const struct simtemp_gen_params *p,
+					s32 *out, unsigned int n)
+{
+	s32 offset = 0;
+	unsigned int i;
+
+	switch (p->mode) {
+	case SIMTEMP_GEN_NOISY:
+		simtemp_gen_noise(st, out, n, p->base_mC, p->spread_mC, p->noise_mC, p->dist);
+		return;
+	case SIMTEMP_GEN_RAMP:
+		st->ramp_mC += p->ramp_step_mC;
+		offset = st->ramp_mC;
+		break;
+	case SIMTEMP_GEN_SINE:
+		st->phase = (st->phase + SIMTEMP_GEN_SINE_STEP) & 0xffff;
+		offset = (p->amplitude_mC * simtemp_gen_sine_q15(st->phase)) >> 15;
+		break;
+	case SIMTEMP_GEN_NORMAL:
+	default:
+		break;
+	}
+
+	for (i = 0; i < n; i++)
+		out[i] = p->base_mC + (s32)i * p->spread_mC + offset;
+}
+
+/*
+ * n consecutive samples of a single stream (backfill, synthetic load,
+ * benchmarks). Same sequence as n calls of simtemp_gen_channels(.., 1)
+ * for ramp and sine.
+ */
+static inline void simtemp_gen_batch(struct simtemp_gen_state *st, const struct simtemp_gen_params *p,
+				     s32 *out, unsigned int n)
+{
+	s32 ramp = st->ramp_mC;
+	u32 phase = st->phase;
+	unsigned int i;
+
+	switch (p->mode) {
+	case SIMTEMP_GEN_NOISY:
+		simtemp_gen_noise(st, out, n, p->base_mC, 0, p->noise_mC, p->dist);
+		break;
+	case SIMTEMP_GEN_RAMP:
+		for (i = 0; i < n; i++)
+			out[i] = p->base_mC + ramp + (s32)(i + 1) * p->ramp_step_mC;
+		st->ramp_mC = ramp + (s32)n * p->ramp_step_mC;
+		break;
+	case SIMTEMP_GEN_SINE:
+		for (i = 0; i < n; i++)
+			out[i] = p->base_mC + ((p->amplitude_mC *
+				 simtemp_gen_sine_q15((phase + (i + 1) * SIMTEMP_GEN_SINE_STEP) & 0xffff)) >> 15);
+		st->phase = (phase + n * SIMTEMP_GEN_SINE_STEP) & 0xffff;
+		break;
+	case SIMTEMP_GEN_NORMAL:
+	default:
+		for (i = 0; i < n; i++)
+			out[i] = p->base_mC;
+		break;
+	}
+}
+
+#endif /* _SIMTEMP_GEN_H */
@@ -0,0 +1,631 @@
+/*
+ * kernel/simtemp_kunit.c
+ * KUnit suite of the nxp_simtemp data path.
+ *
+ * Exercises the kernel agnostic core (simtemp_core.h) and generator
+ * (simtemp_gen.h) the driver is built from, with a kfifo and a spinlock
+ * standing in for the device, so it runs under kunit.py in UML or QEMU
+ * without loading the driver. The *_timing cases are microbenchmarks:
+ * they report ns per operation with kunit_info() and only fail on wrong
+ * results, never on speed.
+ */
+
+#include <kunit/test.h>
+#include <linux/completion.h>
+#include <linux/kfifo.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/limits.h>
+#include <linux/math64.h>
+#include <linux/minmax.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/uio.h>
+
+#include "simtemp_core.h"
+
+#define TEST_FIFO_RECORDS 64		// Records of the test FIFO (rounded up by kfifo)
+#define TEST_STAGE_RECORDS 64		// Records per read_iter batch (STAGE_RECORDS)
+#define TEST_THRESHOLD_mC 45000		// Driver default threshold
+#define TEST_PASSES 20000			// Producer passes of the concurrency case
+#define TEST_TIMING_LOOPS 10000		// Iterations of every timing case
+
+/* Device stand-in: the sample FIFO, its lock and its accounting */
+struct simtemp_test_dev {
+	spinlock_t lock;
+	struct kfifo fifo;
+	struct simtemp_core_drops drops;
+	u64 next_seq;
+	unsigned int channels;
+	unsigned int passes;
+	struct completion done;
+};
+
+static const struct simtemp_gen_params simtemp_test_params = {
+	.mode = SIMTEMP_GEN_NOISY,
+	.base_mC = 25000,
+	.spread_mC = 250,
+	.noise_mC = 1000,
+	.dist = SIMTEMP_GEN_DIST_UNIFORM,
+	.ramp_step_mC = 10,
+	.amplitude_mC = 1000,
+};
+
+/* One producer pass of temps into the test FIFO, as simtemp_sample_enqueue() does */
+static unsigned int simtemp_test_enqueue(struct simtemp_test_dev *td, const s32 *temps,
+					 struct simtemp_sample_v2 *rec, u64 timestamp_ns)
+{
+	unsigned int pushed;
+
+	simtemp_core_records(rec, temps, td->channels, timestamp_ns, TEST_THRESHOLD_mC, &td->next_seq);
+	spin_lock(&td->lock);
+	pushed = simtemp_core_admit(&td->drops, rec, td->channels, kfifo_avail(&td->fifo) / sizeof(*rec));
+	kfifo_in(&td->fifo, rec, pushed * sizeof(*rec));
+	spin_unlock(&td->lock);
+
+	return pushed;
+}
+
+/* Up to n records out of the test FIFO, as simtemp_read_iter() does */
+static unsigned int simtemp_test_dequeue(struct simtemp_test_dev *td, struct simtemp_sample_v2 *rec,
+					 unsigned int n)
+{
+	unsigned int i;
+
+	spin_lock(&td->lock);
+	n = kfifo_out(&td->fifo, rec, n * sizeof(*rec)) / sizeof(*rec);
+	for (i = 0; i < n; i++)
+		simtemp_core_pop(&td->drops, &rec[i]);
+	spin_unlock(&td->lock);
+
+	return n;
+}
+
+/* ---------------------------------------------------------------------------
+ * Records and FIFO
+ */
+
+static void simtemp_test_records(struct kunit *test)
+{
+	struct simtemp_sample_v2 rec[4];
+	s32 temps[4] = { 20000, 46000, 30000, 45000 };
+	u64 next_seq = 7;
+	unsigned int i;
+
+	KUNIT_EXPECT_TRUE(test, simtemp_core_records(rec, temps, 4, 1234, TEST_THRESHOLD_mC, &next_seq));
+	KUNIT_EXPECT_EQ(test, next_seq, 11ULL);
+
+	for (i = 0; i < 4; i++) {
+		KUNIT_EXPECT_EQ(test, rec[i].timestamp_ns, 1234ULL);
+		KUNIT_EXPECT_EQ(test, rec[i].temp_mC, temps[i]);
+		KUNIT_EXPECT_EQ(test, rec[i].seq, 7ULL + i);
+		KUNIT_EXPECT_EQ(test, SIMTEMP_FLAG_CHANNEL(rec[i].flags), i);
+		KUNIT_EXPECT_EQ(test, SIMTEMP_FLAG_DROPS(rec[i].flags), 0U);
+	}
+}
+
+static void simtemp_test_threshold(struct kunit *test)
+{
+	struct simtemp_sample_v2 rec[2];
+	s32 below[2] = { TEST_THRESHOLD_mC - 1, TEST_THRESHOLD_mC };
+	u64 next_seq = 0;
+
+	// Only a temperature strictly above the threshold crosses it
+	KUNIT_EXPECT_EQ(test, simtemp_core_flags(TEST_THRESHOLD_mC - 1, TEST_THRESHOLD_mC, 0),
+			SIMTEMP_FLAG_NEW_SAMPLE);
+	KUNIT_EXPECT_EQ(test, simtemp_core_flags(TEST_THRESHOLD_mC, TEST_THRESHOLD_mC, 0),
+			SIMTEMP_FLAG_NEW_SAMPLE);
+	KUNIT_EXPECT_EQ(test, simtemp_core_flags(TEST_THRESHOLD_mC + 1, TEST_THRESHOLD_mC, 3),
+			SIMTEMP_FLAG_THRESHOLD_CROSSED | (3U << SIMTEMP_FLAG_CHANNEL_SHIFT));
+	KUNIT_EXPECT_EQ(test, simtemp_core_flags(INT_MIN, INT_MIN, 0), SIMTEMP_FLAG_NEW_SAMPLE);
+
+	KUNIT_EXPECT_FALSE(test, simtemp_core_records(rec, below, 2, 0, TEST_THRESHOLD_mC, &next_seq));
+}
+
+static void simtemp_test_fifo_order(struct kunit *test)
+{
+	struct simtemp_test_dev *td = test->priv;
+	struct simtemp_sample_v2 rec[SIMTEMP_MAX_CHANNELS], out[TEST_FIFO_RECORDS];
+	s32 temps[4] = { 1, 2, 3, 4 };
+	unsigned int i, n;
+
+	td->channels = 4;
+	for (i = 0; i < 3; i++)
+		KUNIT_ASSERT_EQ(test, simtemp_test_enqueue(td, temps, rec, i), 4U);
+
+	// First in, first out across passes and channels
+	n = simtemp_test_dequeue(td, out, TEST_FIFO_RECORDS);
+	KUNIT_ASSERT_EQ(test, n, 12U);
+	for (i = 0; i < n; i++) {
+		KUNIT_EXPECT_EQ(test, out[i].seq, (u64)i);
+		KUNIT_EXPECT_EQ(test, out[i].timestamp_ns, (u64)(i / 4));
+		KUNIT_EXPECT_EQ(test, SIMTEMP_FLAG_CHANNEL(out[i].flags), i % 4);
+	}
+	KUNIT_EXPECT_EQ(test, simtemp_test_dequeue(td, out, TEST_FIFO_RECORDS), 0U);
+}
+
+static void simtemp_test_fifo_full(struct kunit *test)
+{
+	struct simtemp_test_dev *td = test->priv;
+	struct simtemp_sample_v2 rec[SIMTEMP_MAX_CHANNELS], out[TEST_FIFO_RECORDS];
+	s32 temps[SIMTEMP_MAX_CHANNELS] = { 0 };
+	unsigned int cap = kfifo_size(&td->fifo) / sizeof(rec[0]);
+	unsigned int i, n, pushed = 0;
+	u64 last = 0;
+
+	td->channels = 8;
+	for (i = 0; i < cap; i += 8)
+		pushed += simtemp_test_enqueue(td, temps, rec, i);
+
+	// The pass that did not fit is cut short, the next one is dropped whole
+	KUNIT_EXPECT_EQ(test, pushed, cap);
+	KUNIT_EXPECT_EQ(test, simtemp_test_enqueue(td, temps, rec, 0), 0U);
+	KUNIT_EXPECT_EQ(test, td->drops.total, (u64)(td->next_seq - cap));
+	KUNIT_EXPECT_EQ(test, (u64)td->drops.pending, td->drops.total);
+
+	// Queued records are the oldest ones
+	while ((n = simtemp_test_dequeue(td, out, TEST_FIFO_RECORDS)))
+		last = out[n - 1].seq;
+	KUNIT_EXPECT_EQ(test, last, (u64)cap - 1);
+
+	// The first record admitted after the drain reports them, the seq gap agrees
+	KUNIT_EXPECT_EQ(test, simtemp_test_enqueue(td, temps, rec, 0), 8U);
+	KUNIT_ASSERT_EQ(test, simtemp_test_dequeue(td, out, 1), 1U);
+	KUNIT_EXPECT_EQ(test, (u64)SIMTEMP_FLAG_DROPS(out[0].flags), td->drops.total);
+	KUNIT_EXPECT_EQ(test, out[0].seq - cap, td->drops.total);
+	KUNIT_EXPECT_EQ(test, td->drops.pending, 0U);
+}
+
+static void simtemp_test_overwrite(struct kunit *test)
+{
+	struct simtemp_core_drops d = { 0 };
+	struct simtemp_sample_v2 rec = { .flags = SIMTEMP_FLAG_NEW_SAMPLE };
+
+	// Room for 1 of 3 new records: the 2 oldest of 4 queued go
+	KUNIT_EXPECT_EQ(test, simtemp_core_overwrite(&d, 3, 1, 4), 2U);
+	KUNIT_EXPECT_EQ(test, d.head_lost, 2U);
+	KUNIT_EXPECT_EQ(test, d.overwritten, 2ULL);
+
+	// Never more than what is queued, nothing when it fits
+	KUNIT_EXPECT_EQ(test, simtemp_core_overwrite(&d, 10, 0, 3), 3U);
+	KUNIT_EXPECT_EQ(test, simtemp_core_overwrite(&d, 2, 2, 5), 0U);
+	KUNIT_EXPECT_EQ(test, d.head_lost, 5U);
+	KUNIT_EXPECT_EQ(test, simtemp_core_lost(&d), 5ULL);
+
+	// The next record popped reports them once
+	simtemp_core_pop(&d, &rec);
+	KUNIT_EXPECT_EQ(test, SIMTEMP_FLAG_DROPS(rec.flags), 5U);
+	KUNIT_EXPECT_EQ(test, rec.flags & ~SIMTEMP_FLAG_DROPS_MASK, SIMTEMP_FLAG_NEW_SAMPLE);
+	KUNIT_EXPECT_EQ(test, d.head_lost, 0U);
+	rec.flags = 0;
+	simtemp_core_pop(&d, &rec);
+	KUNIT_EXPECT_EQ(test, rec.flags, 0U);
+
+	// An overwritten record passes on the drops it was carrying
+	simtemp_core_flag_drops(&rec, 4);
+	KUNIT_EXPECT_EQ(test, simtemp_core_overwrite(&d, 1, 0, 1), 1U);
+	simtemp_core_discard(&d, &rec);
+	KUNIT_EXPECT_EQ(test, d.head_lost, 5U);
+}
+
+static void simtemp_test_drops_saturate(struct kunit *test)
+{
+	struct simtemp_core_drops d = { 0 };
+	struct simtemp_sample_v2 rec[1] = { { .flags = SIMTEMP_FLAG_NEW_SAMPLE } };
+
+	KUNIT_EXPECT_EQ(test, simtemp_core_drops_add(0xfffffff0U, 0x100), 0xffffffffU);
+
+	// The 16 bit field of the record stops at its maximum, seq tells the rest
+	KUNIT_EXPECT_EQ(test, simtemp_core_admit(&d, rec, 1, 0), 0U);
+	d.pending = 100000;
+	KUNIT_EXPECT_EQ(test, simtemp_core_admit(&d, rec, 1, 1), 1U);
+	KUNIT_EXPECT_EQ(test, SIMTEMP_FLAG_DROPS(rec[0].flags), SIMTEMP_FLAG_DROPS_MAX);
+	KUNIT_EXPECT_TRUE(test, rec[0].flags & SIMTEMP_FLAG_NEW_SAMPLE);
+}
+
+static void simtemp_test_deliver(struct kunit *test)
+{
+	struct simtemp_sample_v2 rec[4], out[4];
+	s32 temps[4] = { 10, 11, 12, 13 };
+	u64 next_seq = 0;
+	unsigned int i;
+
+	simtemp_core_records(rec, temps, 4, 0, TEST_THRESHOLD_mC, &next_seq);
+	for (i = 0; i < 4; i++)
+		simtemp_core_flag_drops(&rec[i], 9);
+
+	// Channels 0 and 2, without the drops of the shared FIFO
+	KUNIT_ASSERT_EQ(test, simtemp_core_deliver(rec, 4, 0x5, out), 2U);
+	KUNIT_EXPECT_EQ(test, out[0].temp_mC, 10);
+	KUNIT_EXPECT_EQ(test, out[1].temp_mC, 12);
+	KUNIT_EXPECT_EQ(test, out[1].seq, 2ULL);
+	KUNIT_EXPECT_EQ(test, SIMTEMP_FLAG_DROPS(out[0].flags), 0U);
+	KUNIT_EXPECT_EQ(test, SIMTEMP_FLAG_CHANNEL(out[1].flags), 2U);
+
+	KUNIT_EXPECT_EQ(test, simtemp_core_deliver(rec, 4, U64_MAX, out), 4U);
+	KUNIT_EXPECT_EQ(test, simtemp_core_deliver(rec, 4, 1ULL << 63, out), 0U);
+
+	// A channel id beyond the mask width is never delivered
+	rec[0].flags = 200U << SIMTEMP_FLAG_CHANNEL_SHIFT;
+	KUNIT_EXPECT_EQ(test, simtemp_core_deliver(rec, 1, U64_MAX, out), 0U);
+}
+
+/* ---------------------------------------------------------------------------
+ * Aggregation and history
+ */
+
+static void simtemp_test_agg_samples(struct kunit *test)
+{
+	struct simtemp_core_agg agg = { 0 };
+	struct simtemp_aggregate out;
+	struct simtemp_sample_v2 rec = { .flags = 5U << SIMTEMP_FLAG_CHANNEL_SHIFT };
+	s32 temps[4] = { -3, 9, 2, 4 };
+	unsigned int i;
+
+	for (i = 0; i < 4; i++) {
+		rec.temp_mC = temps[i];
+		rec.timestamp_ns = 100 + i;
+		if (i == 1)
+			rec.flags |= SIMTEMP_FLAG_THRESHOLD_CROSSED;
+		else
+			rec.flags &= ~SIMTEMP_FLAG_THRESHOLD_CROSSED;
+		KUNIT_EXPECT_EQ(test, simtemp_core_agg_add(&agg, &rec, i, 4, 0, &out), i == 3);
+	}
+
+	KUNIT_EXPECT_EQ(test, out.min_mC, -3);
+	KUNIT_EXPECT_EQ(test, out.max_mC, 9);
+	KUNIT_EXPECT_EQ(test, out.mean_mC, 3);
+	KUNIT_EXPECT_EQ(test, out.count, 4U);
+	KUNIT_EXPECT_EQ(test, out.timestamp_ns, 103ULL);
+	KUNIT_EXPECT_EQ(test, SIMTEMP_FLAG_CHANNEL(out.flags), 5U);
+	KUNIT_EXPECT_TRUE(test, out.flags & SIMTEMP_FLAG_THRESHOLD_CROSSED);
+	KUNIT_EXPECT_TRUE(test, out.flags & SIMTEMP_FLAG_NEW_SAMPLE);
+
+	// The next sample opens a fresh window
+	rec.temp_mC = 50;
+	rec.flags &= ~SIMTEMP_FLAG_THRESHOLD_CROSSED;
+	KUNIT_EXPECT_FALSE(test, simtemp_core_agg_add(&agg, &rec, 4, 4, 0, &out));
+	KUNIT_EXPECT_EQ(test, agg.min_mC, 50);
+	KUNIT_EXPECT_EQ(test, agg.count, 1U);
+	KUNIT_EXPECT_EQ(test, agg.flags & SIMTEMP_FLAG_THRESHOLD_CROSSED, 0U);
+}
+
+static void simtemp_test_agg_window(struct kunit *test)
+{
+	struct simtemp_core_agg agg = { 0 };
+	struct simtemp_aggregate out;
+	struct simtemp_sample_v2 rec = { .temp_mC = 7 };
+
+	// 2 ms window, whichever of samples and time closes first
+	KUNIT_EXPECT_FALSE(test, simtemp_core_agg_add(&agg, &rec, 0, 0, 2, &out));
+	KUNIT_EXPECT_FALSE(test, simtemp_core_agg_add(&agg, &rec, 1999999, 0, 2, &out));
+	KUNIT_EXPECT_TRUE(test, simtemp_core_agg_add(&agg, &rec, 2000000, 0, 2, &out));
+	KUNIT_EXPECT_EQ(test, out.count, 3U);
+	KUNIT_EXPECT_EQ(test, out.mean_mC, 7);
+
+	KUNIT_EXPECT_FALSE(test, simtemp_core_agg_add(&agg, &rec, 3000000, 2, 2, &out));
+	KUNIT_EXPECT_TRUE(test, simtemp_core_agg_add(&agg, &rec, 3000001, 2, 2, &out));
+	KUNIT_EXPECT_EQ(test, out.count, 2U);
+}
+
+static void simtemp_test_history_find(struct kunit *test)
+{
+	struct simtemp_core_hist ring[8];
+	u64 pos;
+
+	// Live window [5, 13) of an 8 slot ring, wrapped, 10 ns apart
+	for (pos = 5; pos < 13; pos++)
+		ring[pos & 7].mono_ns = pos * 10;
+
+	KUNIT_EXPECT_EQ(test, simtemp_core_history_find(ring, 7, 5, 13, 0), 5ULL);
+	KUNIT_EXPECT_EQ(test, simtemp_core_history_find(ring, 7, 5, 13, 50), 5ULL);
+	KUNIT_EXPECT_EQ(test, simtemp_core_history_find(ring, 7, 5, 13, 51), 6ULL);
+	KUNIT_EXPECT_EQ(test, simtemp_core_history_find(ring, 7, 5, 13, 80), 8ULL);
+	KUNIT_EXPECT_EQ(test, simtemp_core_history_find(ring, 7, 5, 13, 120), 12ULL);
+	KUNIT_EXPECT_EQ(test, simtemp_core_history_find(ring, 7, 5, 13, 121), 13ULL);
+	KUNIT_EXPECT_EQ(test, simtemp_core_history_find(ring, 7, 13, 13, 0), 13ULL);
+}
+
+/* ---------------------------------------------------------------------------
+ * Generator
+ */
+
+static void simtemp_test_gen_seeded(struct kunit *test)
+{
+	struct simtemp_gen_params p = simtemp_test_params;
+	struct simtemp_gen_state a, b;
+	s32 out_a[SIMTEMP_MAX_CHANNELS], out_b[SIMTEMP_MAX_CHANNELS];
+	unsigned int pass, i, l;
+
+	// Lanes are never left at the xorshift fixed point
+	simtemp_gen_seed(&a, 0);
+	for (l = 0; l < SIMTEMP_GEN_LANES; l++)
+		KUNIT_EXPECT_NE(test, a.lane[l], 0U);
+
+	// The same seed replays the same sequence, in range, for both distributions
+	for (p.dist = SIMTEMP_GEN_DIST_UNIFORM; p.dist <= SIMTEMP_GEN_DIST_GAUSSIAN; p.dist++) {
+		simtemp_gen_seed(&a, 42);
+		simtemp_gen_seed(&b, 42);
+		for (pass = 0; pass < 16; pass++) {
+			simtemp_gen_channels(&a, &p, out_a, 13);
+			simtemp_gen_channels(&b, &p, out_b, 13);
+			KUNIT_EXPECT_EQ(test, memcmp(out_a, out_b, 13 * sizeof(s32)), 0);
+			for (i = 0; i < 13; i++) {
+				KUNIT_EXPECT_GE(test, out_a[i], p.base_mC + (s32)i * p.spread_mC);
+				KUNIT_EXPECT_LT(test, out_a[i], p.base_mC + (s32)i * p.spread_mC + (s32)p.noise_mC);
+			}
+		}
+	}
+
+	p.dist = SIMTEMP_GEN_DIST_UNIFORM;
+	simtemp_gen_seed(&a, 42);
+	simtemp_gen_seed(&b, 43);
+	simtemp_gen_channels(&a, &p, out_a, SIMTEMP_MAX_CHANNELS);
+	simtemp_gen_channels(&b, &p, out_b, SIMTEMP_MAX_CHANNELS);
+	KUNIT_EXPECT_NE(test, memcmp(out_a, out_b, sizeof(out_a)), 0);
+}
+
+static void simtemp_test_gen_modes(struct kunit *test)
+{
+	struct simtemp_gen_params p = simtemp_test_params;
+	struct simtemp_gen_state st;
+	s32 out[4];
+	unsigned int pass, i;
+
+	simtemp_gen_seed(&st, 1);
+	p.mode = SIMTEMP_GEN_NORMAL;
+	simtemp_gen_channels(&st, &p, out, 4);
+	for (i = 0; i < 4; i++)
+		KUNIT_EXPECT_EQ(test, out[i], p.base_mC + (s32)i * p.spread_mC);
+
+	// Ramp: one step per pass, shared by every channel
+	p.mode = SIMTEMP_GEN_RAMP;
+	for (pass = 1; pass <= 3; pass++) {
+		simtemp_gen_channels(&st, &p, out, 4);
+		for (i = 0; i < 4; i++)
+			KUNIT_EXPECT_EQ(test, out[i], p.base_mC + (s32)i * p.spread_mC + (s32)pass * p.ramp_step_mC);
+	}
+
+	// Sine stays within its amplitude
+	p.mode = SIMTEMP_GEN_SINE;
+	for (pass = 0; pass < 1024; pass++) {
+		simtemp_gen_channels(&st, &p, out, 1);
+		KUNIT_EXPECT_LE(test, out[0], p.base_mC + p.amplitude_mC);
+		KUNIT_EXPECT_GE(test, out[0], p.base_mC - p.amplitude_mC);
+	}
+}
+
+static void simtemp_test_gen_batch(struct kunit *test)
+{
+	struct simtemp_gen_params p = simtemp_test_params;
+	struct simtemp_gen_state a, b;
+	s32 batch[40], one;
+	int mode;
+	unsigned int i;
+
+	// simtemp_gen_batch() is n single channel passes for ramp and sine
+	for (mode = SIMTEMP_GEN_RAMP; mode <= SIMTEMP_GEN_SINE; mode++) {
+		p.mode = mode;
+		simtemp_gen_seed(&a, 7);
+		simtemp_gen_seed(&b, 7);
+		simtemp_gen_batch(&a, &p, batch, ARRAY_SIZE(batch));
+		for (i = 0; i < ARRAY_SIZE(batch); i++) {
+			simtemp_gen_channels(&b, &p, &one, 1);
+			KUNIT_EXPECT_EQ(test, batch[i], one);
+		}
+		KUNIT_EXPECT_EQ(test, a.ramp_mC, b.ramp_mC);
+		KUNIT_EXPECT_EQ(test, a.phase, b.phase);
+	}
+}
+
+/* ---------------------------------------------------------------------------
+ * Concurrency
+ */
+
+static int simtemp_test_producer(void *data)
+{
+	struct simtemp_test_dev *td = data;
+	struct simtemp_sample_v2 rec[SIMTEMP_MAX_CHANNELS];
+	s32 temps[SIMTEMP_MAX_CHANNELS] = { 0 };
+	unsigned int pass;
+
+	for (pass = 0; pass < td->passes; pass++) {
+		simtemp_test_enqueue(td, temps, rec, pass);
+		if (!(pass & 63))
+			cond_resched();
+	}
+	complete(&td->done);
+
+	return 0;
+}
+
+/*
+ * A producer thread against a reader: records come out in seq order, and
+ * every gap in seq is reported by the drop count of the record after it
+ */
+static void simtemp_test_producer_reader(struct kunit *test)
+{
+	struct simtemp_test_dev *td = test->priv;
+	struct simtemp_sample_v2 out[16];
+	struct task_struct *task;
+	u64 expect = 0, received = 0, gap;
+	unsigned int i, n;
+	bool finished;
+
+	td->channels = 4;
+	td->passes = TEST_PASSES;
+	task = kthread_run(simtemp_test_producer, td, "simtemp_test");
+	KUNIT_ASSERT_FALSE(test, IS_ERR(task));
+
+	do {
+		finished = completion_done(&td->done);
+		n = simtemp_test_dequeue(td, out, ARRAY_SIZE(out));
+		for (i = 0; i < n; i++) {
+			KUNIT_EXPECT_GE(test, out[i].seq, expect);
+			gap = out[i].seq >= expect ? out[i].seq - expect : 0;
+			KUNIT_EXPECT_EQ(test, (u64)SIMTEMP_FLAG_DROPS(out[i].flags),
+					min_t(u64, gap, SIMTEMP_FLAG_DROPS_MAX));
+			expect = out[i].seq + 1;
+		}
+		received += n;
+		if (!n)
+			cond_resched();
+	} while (n || !finished);
+
+	// The FIFO goes away with the test, never under a running producer
+	wait_for_completion(&td->done);
+
+	KUNIT_EXPECT_EQ(test, td->next_seq, (u64)TEST_PASSES * 4);
+	KUNIT_EXPECT_EQ(test, received + td->drops.total, td->next_seq);
+}
+
+/* ---------------------------------------------------------------------------
+ * Microbenchmarks
+ */
+
+static void simtemp_test_enqueue_timing(struct kunit *test)
+{
+	struct simtemp_test_dev *td = test->priv;
+	struct simtemp_sample_v2 rec[SIMTEMP_MAX_CHANNELS];
+	s32 temps[SIMTEMP_MAX_CHANNELS] = { 0 };
+	unsigned int i, pushed = 0;
+	u64 t0, dt;
+
+	// A pass of 8 channels in and out, the FIFO never fills
+	td->channels = 8;
+	t0 = ktime_get_ns();
+	for (i = 0; i < TEST_TIMING_LOOPS; i++) {
+		pushed += simtemp_test_enqueue(td, temps, rec, i);
+		simtemp_test_dequeue(td, rec, td->channels);
+	}
+	dt = ktime_get_ns() - t0;
+
+	KUNIT_EXPECT_EQ(test, pushed, TEST_TIMING_LOOPS * td->channels);
+	kunit_info(test, "enqueue + dequeue: %llu ns per pass of %u channels\n",
+		   div_u64(dt, TEST_TIMING_LOOPS), td->channels);
+}
+
+static void simtemp_test_generate_timing(struct kunit *test)
+{
+	struct simtemp_gen_params p = simtemp_test_params;
+	struct simtemp_gen_state st;
+	s32 out[SIMTEMP_MAX_CHANNELS];
+	unsigned int i;
+	u64 t0, dt;
+	s64 sum = 0;
+
+	simtemp_gen_seed(&st, 1);
+	for (p.dist = SIMTEMP_GEN_DIST_UNIFORM; p.dist <= SIMTEMP_GEN_DIST_GAUSSIAN; p.dist++) {
+		t0 = ktime_get_ns();
+		for (i = 0; i < TEST_TIMING_LOOPS; i++) {
+			simtemp_gen_channels(&st, &p, out, SIMTEMP_MAX_CHANNELS);
+			sum += out[i % SIMTEMP_MAX_CHANNELS];
+		}
+		dt = ktime_get_ns() - t0;
+		kunit_info(test, "generate (%s): %llu ps per sample\n",
+			   p.dist == SIMTEMP_GEN_DIST_GAUSSIAN ? "gaussian" : "uniform",
+			   div_u64(dt * 1000, TEST_TIMING_LOOPS * SIMTEMP_MAX_CHANNELS));
+	}
+
+	// Keeps the loop from being optimised away
+	KUNIT_EXPECT_GT(test, sum, 0LL);
+}
+
+static void simtemp_test_copy_timing(struct kunit *test)
+{
+	size_t len = TEST_STAGE_RECORDS * sizeof(struct simtemp_sample);
+	struct simtemp_sample_v2 *stage;
+	struct iov_iter iter;
+	struct kvec kv;
+	unsigned int i, r;
+	u64 t0, dt;
+
+	stage = kunit_kcalloc(test, TEST_STAGE_RECORDS, sizeof(*stage), GFP_KERNEL);
+	kv.iov_base = kunit_kzalloc(test, len, GFP_KERNEL);
+	kv.iov_len = len;
+	KUNIT_ASSERT_NOT_NULL(test, stage);
+	KUNIT_ASSERT_NOT_NULL(test, kv.iov_base);
+
+	// A full staging batch packed to v1 and copied out, as read_iter does
+	t0 = ktime_get_ns();
+	for (i = 0; i < TEST_TIMING_LOOPS; i++) {
+		for (r = 0; r < TEST_STAGE_RECORDS; r++) {
+			stage[r].flags &= ~SIMTEMP_FLAG_DROPS_MASK;
+			memmove((char *)stage + r * sizeof(struct simtemp_sample), &stage[r],
+				sizeof(struct simtemp_sample));
+		}
+		iov_iter_kvec(&iter, ITER_DEST, &kv, 1, len);
+		if (copy_to_iter(stage, len, &iter) != len)
+			break;
+	}
+	dt = ktime_get_ns() - t0;
+
+	KUNIT_EXPECT_EQ(test, i, TEST_TIMING_LOOPS);
+	kunit_info(test, "read copy: %llu ps per v1 record\n",
+		   div_u64(dt * 1000, TEST_TIMING_LOOPS * TEST_STAGE_RECORDS));
+}
+
+/* ---------------------------------------------------------------------------
+ * Suite
+ */
+
+static int simtemp_test_init(struct kunit *test)
+{
+	struct simtemp_test_dev *td;
+	int ret;
+
+	td = kunit_kzalloc(test, sizeof(*td), GFP_KERNEL);
+	if (!td)
+		return -ENOMEM;
+	spin_lock_init(&td->lock);
+	init_completion(&td->done);
+	test->priv = td;
+
+	ret = kfifo_alloc(&td->fifo, TEST_FIFO_RECORDS * sizeof(struct simtemp_sample_v2), GFP_KERNEL);
+
+	return ret;
+}
+
+static void simtemp_test_exit(struct kunit *test)
+{
+	struct simtemp_test_dev *td = test->priv;
+
+	// Also runs after a failed init, a zeroed kfifo frees nothing
+	if (td)
+		kfifo_free(&td->fifo);
+}
+
+static struct kunit_case simtemp_test_cases[] = {
+	KUNIT_CASE(simtemp_test_records),
+	KUNIT_CASE(simtemp_test_threshold),
+	KUNIT_CASE(simtemp_test_fifo_order),
+	KUNIT_CASE(simtemp_test_fifo_full),
+	KUNIT_CASE(simtemp_test_overwrite),
+	KUNIT_CASE(simtemp_test_drops_saturate),
+	KUNIT_CASE(simtemp_test_deliver),
+	KUNIT_CASE(simtemp_test_agg_samples),
+	KUNIT_CASE(simtemp_test_agg_window),
+	KUNIT_CASE(simtemp_test_history_find),
+	KUNIT_CASE(simtemp_test_gen_seeded),
+	KUNIT_CASE(simtemp_test_gen_modes),
+	KUNIT_CASE(simtemp_test_gen_batch),
+	KUNIT_CASE(simtemp_test_producer_reader),
+	KUNIT_CASE(simtemp_test_enqueue_timing),
+	KUNIT_CASE(simtemp_test_generate_timing),
+	KUNIT_CASE(simtemp_test_copy_timing),
+	{}
+};
+
+static struct kunit_suite simtemp_test_suite = {
+	.name = "simtemp",
+	.init = simtemp_test_init,
+	.exit = simtemp_test_exit,
+	.test_cases = simtemp_test_cases,
+};
+kunit_test_suite(simtemp_test_suite);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_AUTHOR("Eduardo Naranjo Alvarado");
+MODULE_DESCRIPTION("KUnit tests of the nxp_simtemp data path");
@@ -59,6 +59,24 @@ else
     echo "Warning: python3 not found; skipping CLI checks."
 fi
 
+# Build the userspace benchmarks (same generator and data path code as the driver)
+BENCH_DIR="$TOPDIR/user/bench"
+if [ -d "$BENCH_DIR" ] && command -v cc >/dev/null 2>&1; then
+    echo "Building userspace benchmarks..."
+    make -C "$BENCH_DIR"
+else
+    echo "Warning: C compiler not found; skipping userspace benchmarks."
+fi
+
+# Build the userspace client library (libsimtemp) and its example
+LIB_DIR="$TOPDIR/user/lib"
+if [ -d "$LIB_DIR" ] && command -v cc >/dev/null 2>&1; then
+    echo "Building libsimtemp..."
+    make -C "$LIB_DIR"
+else
+    echo "Warning: C compiler not found; skipping libsimtemp."
+fi
+
 echo "Build completed successfully."
 exit 0
 
@@ -0,0 +1,195 @@
+#!/usr/bin/env bash
+# scripts/stress.sh
+# Soak test: insmod -> blocking/poll readers + sysfs writers at the fastest
+# period -> report throughput and drops -> rmmod, repeated CYCLES times.
+# Checks dmesg for lockdep/KASAN/UBSAN splats, WARN and BUG at the end.
+# Returns 0 if every cycle loaded/unloaded cleanly and dmesg is clean.
+#
+# Tunables (environment): CYCLES, DURATION (seconds per cycle),
+# BLOCK_READERS, POLL_READERS, WRITERS, SAMPLING_US
+
+set -uo pipefail
+
+TOPDIR="$(cd "$(dirname "$0")/.." && pwd)"
+KER_DIR="$TOPDIR/kernel"
+KO_FILE="$(find "$KER_DIR" -maxdepth 1 -type f -name '*.ko' -print -quit || true)"
+SIMTMP_DEVNAME="simtemp0"
+DEVNODE="/dev/$SIMTMP_DEVNAME"
+SIMSYS="/sys/class/simtemp/$SIMTMP_DEVNAME"
+
+CYCLES="${CYCLES:-5}"
+DURATION="${DURATION:-20}"
+BLOCK_READERS="${BLOCK_READERS:-4}"
+POLL_READERS="${POLL_READERS:-4}"
+WRITERS="${WRITERS:-3}"
+SAMPLING_US="${SAMPLING_US:-100}"
+
+WORKDIR="$(mktemp -d)"
+
+# Sudo if not root
+if [ "$(id -u)" -ne 0 ]; then
+    SUDO="sudo"
+else
+    SUDO=""
+fi
+
+if [ -z "$KO_FILE" ]; then
+    echo "ERROR: Module .ko not found in $KER_DIR. Run scripts/build.sh first."
+    exit 2
+fi
+MODNAME="$(basename "$KO_FILE" .ko)"
+
+echo "Using module: $KO_FILE"
+echo "Cycles: $CYCLES x ${DURATION}s, readers: $BLOCK_READERS blocking + $POLL_READERS poll, writers: $WRITERS, sampling_us: $SAMPLING_US"
+
+PIDS=()
+
+stop_load() {
+    for pid in "${PIDS[@]}"; do
+        kill "$pid" 2>/dev/null || true
+    done
+    wait "${PIDS[@]}" 2>/dev/null || true
+    PIDS=()
+}
+
+cleanup() {
+    echo "Cleaning up..."
+    stop_load
+    if lsmod | grep -q "^$MODNAME "; then
+        $SUDO rmmod "$MODNAME" || true
+    fi
+    rm -rf "$WORKDIR"
+}
+trap cleanup EXIT
+
+# Blocking reader: 24-byte v2 records, counts records and reported drops
+block_reader() {
+    $SUDO python3 - "$DEVNODE" "$1" "$TOPDIR/user/cli" <<'EOF'
+import fcntl, os, signal, struct, sys
+sys.path.insert(0, sys.argv[3])
+from simtemp import SIMTEMP_IOC_SET_RECORD_FORMAT, SIMTEMP_RECORD_V2
+records = drops = 0
+def done(*_):
+    open(sys.argv[2], "w").write(f"{records} {drops}\n")
+    sys.exit(0)
+signal.signal(signal.SIGTERM, done)
+fd = os.open(sys.argv[1], os.O_RDONLY)
+fcntl.ioctl(fd, SIMTEMP_IOC_SET_RECORD_FORMAT, struct.pack("I", SIMTEMP_RECORD_V2))
+while True:
+    data = os.read(fd, 24)
+    if len(data) == 24:
+        records += 1
+        drops += struct.unpack("=QiIQ", data)[2] >> 16
+EOF
+}
+
+# poll() reader: non-blocking reads on POLLIN, also wakes on POLLPRI
+poll_reader() {
+    $SUDO python3 - "$DEVNODE" "$1" <<'EOF'
+import os, select, signal, sys
+records = alerts = 0
+def done(*_):
+    open(sys.argv[2], "w").write(f"{records} 0\n")
+    sys.exit(0)
+signal.signal(signal.SIGTERM, done)
+fd = os.open(sys.argv[1], os.O_RDONLY | os.O_NONBLOCK)
+p = select.poll()
+p.register(fd, select.POLLIN | select.POLLPRI)
+while True:
+    for _, ev in p.poll(1000):
+        if ev & select.POLLIN:
+            try:
+                if len(os.read(fd, 16)) == 16:
+                    records += 1
+            except BlockingIOError:
+                pass
+EOF
+}
+
+# sysfs writer: period, threshold and mode in a tight loop
+sysfs_writer() {
+    local modes=(normal noisy ramp sine)
+    local n=0
+    while true; do
+        echo $((SAMPLING_US + (n % 4) * 50)) > "$SIMSYS/sampling_us" 2>/dev/null
+        echo $((20000 + (n % 10) * 1000)) > "$SIMSYS/threshold_mc" 2>/dev/null
+        echo -n "${modes[$((n % 4))]}" > "$SIMSYS/mode" 2>/dev/null
+        n=$((n+1))
+    done
+}
+
+DMESG_START="$($SUDO dmesg | wc -l)"
+failed=0
+
+for cycle in $(seq 1 "$CYCLES"); do
+    echo "=== Cycle $cycle/$CYCLES ==="
+    if ! $SUDO insmod "$KO_FILE" start_delay_ms=0; then
+        echo "ERROR: insmod failed"
+        failed=1
+        break
+    fi
+
+    # Wait for device and sysfs
+    i=0
+    while [ $i -lt 10 ] && { [ ! -e "$DEVNODE" ] || [ ! -d "$SIMSYS" ]; }; do
+        sleep 1
+        i=$((i+1))
+    done
+    if [ $i -ge 10 ]; then
+        echo "ERROR: Device or sysfs did not appear in 10 seconds."
+        failed=1
+        break
+    fi
+
+    echo "$SAMPLING_US" | $SUDO tee "$SIMSYS/sampling_us" >/dev/null
+    echo -n "kthread" | $SUDO tee "$SIMSYS/producer" >/dev/null
+
+    rm -f "$WORKDIR"/reader.*
+    for r in $(seq 1 "$BLOCK_READERS"); do
+        block_reader "$WORKDIR/reader.b$r" &
+        PIDS+=($!)
+    done
+    for r in $(seq 1 "$POLL_READERS"); do
+        poll_reader "$WORKDIR/reader.p$r" &
+        PIDS+=($!)
+    done
+    for w in $(seq 1 "$WRITERS"); do
+        $SUDO bash -c "$(declare -f sysfs_writer); SIMSYS=$SIMSYS SAMPLING_US=$SAMPLING_US sysfs_writer" &
+        PIDS+=($!)
+    done
+
+    sleep "$DURATION"
+
+    # Readers must let go of the device before rmmod, writers keep going
+    # into the unload to race sysfs against the teardown
+    for pid in "${PIDS[@]:0:$((BLOCK_READERS + POLL_READERS))}"; do
+        $SUDO pkill -TERM -P "$pid" 2>/dev/null || true
+    done
+    sleep 1
+
+    records="$(cat "$WORKDIR"/reader.* 2>/dev/null | awk '{r += $1; d += $2} END {print r + 0, d + 0}')"
+    echo "Records read: ${records% *} ($(( ${records% *} / DURATION )) records/s), drops reported: ${records#* }"
+    $SUDO cat "$SIMSYS/stats" | grep -E "Samples taken|FIFO drops|Producer overruns" || true
+
+    if ! $SUDO rmmod "$MODNAME"; then
+        echo "ERROR: rmmod failed"
+        failed=1
+    fi
+    stop_load
+done
+
+# Any splat during the run?
+echo "Checking dmesg..."
+if $SUDO dmesg | tail -n +"$((DMESG_START + 1))" | \
+    grep -E "possible circular locking|possible recursive locking|inconsistent lock state|BUG:|WARNING:|KASAN|UBSAN|Oops|general protection"; then
+    echo "STRESS: FAIL (kernel reported problems above)"
+    exit 1
+fi
+
+if [ $failed -ne 0 ]; then
+    echo "STRESS: FAIL"
+    exit 1
+fi
+
+echo "STRESS: PASS ($CYCLES cycles)"
+exit 0
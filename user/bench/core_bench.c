@@ -0,0 +1,92 @@
+/*
+ * user/bench/core_bench.c
+ * Userspace benchmark of the nxp_simtemp data path.
+ * Runs kernel/simtemp_core.h and kernel/simtemp_gen.h as the driver does,
+ * with a record ring standing in for the own queue of a filtered file:
+ * generate a pass, build the records, fold them into the per channel
+ * aggregates, admit the channels of the reader's mask into the ring
+ * (dropping on overflow), then let the reader drain part of it.
+ *
+ * Usage: core_bench [channels] [passes] [ring_records] [drain_per_pass]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "simtemp_core.h"
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int channels = argc > 1 ? strtoul(argv[1], NULL, 0) : 8;
+	unsigned long passes = argc > 2 ? strtoul(argv[2], NULL, 0) : 2000000;
+	unsigned int ring_len = argc > 3 ? strtoul(argv[3], NULL, 0) : 64;
+	unsigned int drain = argc > 4 ? strtoul(argv[4], NULL, 0) : 6;
+	struct simtemp_gen_params params = {
+		.mode = SIMTEMP_GEN_NOISY,
+		.base_mC = 25000,
+		.spread_mC = 250,
+		.noise_mC = 1000,
+		.ramp_step_mC = 10,
+		.amplitude_mC = 1000,
+	};
+	struct simtemp_sample_v2 rec[SIMTEMP_MAX_CHANNELS], sel[SIMTEMP_MAX_CHANNELS], *ring, out;
+	struct simtemp_core_drops drops = { 0 };
+	struct simtemp_core_agg agg[SIMTEMP_MAX_CHANNELS] = { 0 };
+	struct simtemp_aggregate agg_rec;
+	struct simtemp_gen_state st;
+	s32 temps[SIMTEMP_MAX_CHANNELS];
+	u64 next_seq = 0, head = 0, tail = 0, delivered = 0, reported = 0, windows = 0;
+	u64 mask = 0x5555555555555555ULL;	// every other channel
+	unsigned long p;
+	unsigned int i, n, pushed;
+	double t0, dt;
+
+	if (!channels || channels > SIMTEMP_MAX_CHANNELS || !ring_len || (ring_len & (ring_len - 1))) {
+		fprintf(stderr, "core_bench: channels 1-%d, ring_records a power of two\n", SIMTEMP_MAX_CHANNELS);
+		return 1;
+	}
+	ring = malloc(ring_len * sizeof(*ring));
+	if (!ring)
+		return 1;
+
+	simtemp_gen_seed(&st, 1);
+	t0 = now_s();
+	for (p = 0; p < passes; p++) {
+		// Producer: one pass of every channel
+		simtemp_gen_channels(&st, &params, temps, channels);
+		simtemp_core_records(rec, temps, channels, p * 1000000ULL, 25500, &next_seq);
+		for (i = 0; i < channels; i++)
+			windows += simtemp_core_agg_add(&agg[i], &rec[i], p * 1000000LL, 16, 0, &agg_rec);
+		n = simtemp_core_deliver(rec, channels, mask, sel);
+		pushed = simtemp_core_admit(&drops, sel, n, ring_len - (unsigned int)(head - tail));
+		for (i = 0; i < pushed; i++)
+			ring[head++ & (ring_len - 1)] = sel[i];
+
+		// Reader: slower than the producer, so the ring overflows
+		for (i = 0; i < drain && tail != head; i++) {
+			out = ring[tail++ & (ring_len - 1)];
+			delivered++;
+			reported += SIMTEMP_FLAG_DROPS(out.flags);
+		}
+	}
+	dt = now_s() - t0;
+
+	printf("channels %u, ring %u records, drain %u per pass\n", channels, ring_len, drain);
+	printf("%.1f M passes/s, %.1f M samples/s\n", passes / dt / 1e6, passes * channels / dt / 1e6);
+	printf("produced %llu, dropped %llu, delivered %llu, drops reported %llu + %u pending, windows %llu\n",
+	       (unsigned long long)next_seq, (unsigned long long)drops.total,
+	       (unsigned long long)delivered, (unsigned long long)reported, drops.pending,
+	       (unsigned long long)windows);
+
+	free(ring);
+	return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * user/bench/fuzz_core.c
+ * libFuzzer target of the nxp_simtemp data path core (kernel/simtemp_core.h).
+ * The input is a byte stream of operations run against a shared record ring
+ * (drop newest or overwrite oldest), the own ring of a filtered reader, the
+ * per channel aggregates and a history ring, as the driver does. Any broken
+ * invariant aborts, so ASan/UBSan and the fuzzer report it with its input:
+ *
+ * - shared ring: seq increases and every record reports exactly the gap
+ *   since the previous one in its drop bits (saturated at the flag width);
+ * - filtered ring: only channels of the mask, reported drops never exceed
+ *   the seq gap;
+ * - aggregates: min <= mean <= max over at least one sample;
+ * - history: simtemp_core_history_find() returns the lower bound.
+ *
+ * Build with make fuzz_core (clang), run with ./fuzz_core [corpus_dir].
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simtemp_core.h"
+
+#define RING_LEN	64		// Ring storage, the capacity in use comes from the input
+#define HIST_LEN	16
+
+enum {
+	OP_PASS,				// Produce one pass of every channel
+	OP_POP,					// Pop records from the shared ring
+	OP_POP_FILTERED,		// Pop records from the filtered ring
+	OP_HISTORY,				// Search the history ring
+	OP_MASK,				// Change the channel mask of the filtered reader
+	OP_COUNT,
+};
+
+struct fuzz_input {
+	const uint8_t *data;
+	size_t size;
+};
+
+struct fuzz_ring {
+	struct simtemp_sample_v2 rec[RING_LEN];
+	struct simtemp_core_drops drops;
+	u64 head;
+	u64 tail;
+	u64 next_seq;					// Seq the next popped record would have without losses
+};
+
+static uint8_t fuzz_u8(struct fuzz_input *in)
+{
+	uint8_t v = 0;
+
+	if (in->size) {
+		v = in->data[0];
+		in->data++;
+		in->size--;
+	}
+	return v;
+}
+
+static u32 fuzz_u32(struct fuzz_input *in)
+{
+	u32 v = 0;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		v = v << 8 | fuzz_u8(in);
+	return v;
+}
+
+static u64 fuzz_u64(struct fuzz_input *in)
+{
+	return (u64)fuzz_u32(in) << 32 | fuzz_u32(in);
+}
+
+/* The driver's simtemp_fifo_push(), on a ring of cap records */
+static void fuzz_push(struct fuzz_ring *r, unsigned int cap, bool overwrite,
+		      struct simtemp_sample_v2 *rec, unsigned int n)
+{
+	unsigned int used = (unsigned int)(r->head - r->tail);
+	unsigned int room = cap - used;
+	unsigned int discard, pushed, i;
+
+	if (overwrite) {
+		discard = simtemp_core_overwrite(&r->drops, n, room, used);
+		room += discard;
+		while (discard--)
+			simtemp_core_discard(&r->drops, &r->rec[r->tail++ % RING_LEN]);
+	}
+
+	pushed = simtemp_core_admit(&r->drops, rec, n, room);
+	for (i = 0; i < pushed; i++)
+		r->rec[r->head++ % RING_LEN] = rec[i];
+}
+
+static bool fuzz_pop(struct fuzz_ring *r, struct simtemp_sample_v2 *out)
+{
+	if (r->tail == r->head)
+		return false;
+	*out = r->rec[r->tail++ % RING_LEN];
+	simtemp_core_pop(&r->drops, out);
+	return true;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	struct fuzz_input in = { data, size };
+	static struct fuzz_ring shared, filtered;
+	static struct simtemp_core_agg agg[SIMTEMP_MAX_CHANNELS];
+	static struct simtemp_core_hist hist[HIST_LEN];
+	struct simtemp_sample_v2 rec[SIMTEMP_MAX_CHANNELS], sel[SIMTEMP_MAX_CHANNELS], out;
+	struct simtemp_aggregate agg_rec;
+	s32 temps[SIMTEMP_MAX_CHANNELS];
+	u64 seq = 0, hist_head = 0, mono_ns = 0, mask, gap, lo, pos, from;
+	unsigned int cap, channels, agg_samples, agg_window_ms, n, i;
+	bool overwrite;
+	s32 threshold;
+
+	memset(&shared, 0, sizeof(shared));
+	memset(&filtered, 0, sizeof(filtered));
+	memset(agg, 0, sizeof(agg));
+	memset(hist, 0, sizeof(hist));
+
+	cap = 1 + fuzz_u8(&in) % RING_LEN;
+	overwrite = fuzz_u8(&in) & 1;
+	channels = 1 + fuzz_u8(&in) % SIMTEMP_MAX_CHANNELS;
+	agg_samples = fuzz_u8(&in);
+	agg_window_ms = fuzz_u8(&in);
+	threshold = (s32)fuzz_u32(&in);
+	mask = fuzz_u64(&in);
+
+	while (in.size) {
+		switch (fuzz_u8(&in) % OP_COUNT) {
+		case OP_PASS:
+			mono_ns += fuzz_u32(&in);
+			for (i = 0; i < channels; i++)
+				temps[i] = (s32)fuzz_u32(&in);
+			simtemp_core_records(rec, temps, channels, mono_ns, threshold, &seq);
+
+			for (i = 0; i < channels; i++) {
+				if (simtemp_core_agg_add(&agg[i], &rec[i], (s64)mono_ns, agg_samples,
+							 agg_window_ms, &agg_rec) &&
+				    (agg_rec.count < 1 || agg_rec.min_mC > agg_rec.mean_mC ||
+				     agg_rec.mean_mC > agg_rec.max_mC ||
+				     SIMTEMP_FLAG_CHANNEL(agg_rec.flags) != i))
+					abort();
+				hist[hist_head++ % HIST_LEN] = (struct simtemp_core_hist){
+					.mono_ns = mono_ns,
+					.rec = { rec[i].timestamp_ns, rec[i].temp_mC, rec[i].flags },
+				};
+			}
+
+			n = simtemp_core_deliver(rec, channels, mask, sel);
+			fuzz_push(&filtered, cap, overwrite, sel, n);
+			fuzz_push(&shared, cap, overwrite, rec, channels);
+			break;
+
+		case OP_POP:
+			for (n = fuzz_u8(&in) % (RING_LEN + 1); n && fuzz_pop(&shared, &out); n--) {
+				if (out.seq < shared.next_seq)
+					abort();
+				gap = out.seq - shared.next_seq;
+				if (SIMTEMP_FLAG_DROPS(out.flags) != (gap < SIMTEMP_FLAG_DROPS_MAX ? gap : SIMTEMP_FLAG_DROPS_MAX))
+					abort();
+				shared.next_seq = out.seq + 1;
+			}
+			break;
+
+		case OP_POP_FILTERED:
+			for (n = fuzz_u8(&in) % (RING_LEN + 1); n && fuzz_pop(&filtered, &out); n--) {
+				if (out.seq < filtered.next_seq || !(mask & (1ULL << SIMTEMP_FLAG_CHANNEL(out.flags))))
+					abort();
+				if (SIMTEMP_FLAG_DROPS(out.flags) > out.seq - filtered.next_seq)
+					abort();
+				filtered.next_seq = out.seq + 1;
+			}
+			break;
+
+		case OP_HISTORY:
+			from = fuzz_u8(&in) ? mono_ns - fuzz_u32(&in) : fuzz_u64(&in);
+			lo = hist_head > HIST_LEN ? hist_head - HIST_LEN : 0;
+			pos = simtemp_core_history_find(hist, HIST_LEN - 1, lo, hist_head, from);
+			if (pos < lo || pos > hist_head)
+				abort();
+			if (pos < hist_head && hist[pos % HIST_LEN].mono_ns < from)
+				abort();
+			if (pos > lo && hist[(pos - 1) % HIST_LEN].mono_ns >= from)
+				abort();
+			break;
+
+		case OP_MASK:
+			// The reader subscribes again with a new mask and starts on an empty queue
+			mask = fuzz_u64(&in);
+			memset(&filtered, 0, sizeof(filtered));
+			filtered.next_seq = seq;
+			break;
+		}
+	}
+
+	return 0;
+}
@@ -5,10 +5,13 @@
 import os
 import time
 import struct
+import fcntl
 import select
 from datetime import datetime, UTC  # add UTC to imports above
 import argparse
 
+from simtemp import SIMTEMP_IOC_SET_RECORD_FORMAT, SIMTEMP_RECORD_V2
+
 # Structure used by the driver
 # unsigned long long (Q) -> timestamp
 # int (i) -> temperature
@@ -16,6 +19,11 @@ import argparse
 SAMPLE_STRUCT = "Q i I"
 SAMPLE_SIZE = struct.calcsize(SAMPLE_STRUCT)
 
+# v2 record: v1 + unsigned long long (Q) -> sequence number,
+# bits 16..31 of flags -> samples dropped right before this record
+SAMPLE_V2_STRUCT = "=Q i I Q"
+SAMPLE_V2_SIZE = struct.calcsize(SAMPLE_V2_STRUCT)
+
 # Paths to files
 DEV_PATH = "/dev/simtemp0"
 SYSFS_PATH = "/sys/class/simtemp/simtemp0"
@@ -48,8 +56,9 @@ def main():
     parser.add_argument("--timeout", type=int, default=2000, help="Wait time (ms) for poll()")
     parser.add_argument("--sampling", type=int, help="Sampling period in ms")
     parser.add_argument("--threshold", type=int, help="Threshold in milliCelsius")
-    parser.add_argument("--mode", type=str, help="Mode: normal, noisy, or ramp")
+    parser.add_argument("--mode", type=str, help="Mode: normal, noisy, ramp, or sine")
     parser.add_argument("--test", action="store_true", help="Automatic alert test")
+    parser.add_argument("--seq", action="store_true", help="Read v2 records and report lost samples")
     args = parser.parse_args()
 
     # Configure if requested by the user
@@ -79,6 +88,12 @@ def main():
         print("Could not open device:", e)
         return
 
+    # Ask for sequence numbers on this open file
+    if args.seq:
+        fcntl.ioctl(fd, SIMTEMP_IOC_SET_RECORD_FORMAT, struct.pack("I", SIMTEMP_RECORD_V2))
+    rec_size = SAMPLE_V2_SIZE if args.seq else SAMPLE_SIZE
+    perdidas = 0
+
     poller = select.poll()
     poller.register(fd, select.POLLIN | select.POLLPRI)
     
@@ -100,8 +115,15 @@ def main():
                     alerta = True
 
                 if flag & select.POLLIN:
-                    data = os.read(fd, SAMPLE_SIZE)
-                    if len(data) == SAMPLE_SIZE:
+                    data = os.read(fd, rec_size)
+                    if args.seq and len(data) == SAMPLE_V2_SIZE:
+                        ts_ns, temp_mC, flags, seq = struct.unpack(SAMPLE_V2_STRUCT, data)
+                        drops = flags >> 16
+                        perdidas += drops
+                        tiempo = mostrar_tiempo(ts_ns)
+                        print(f"{tiempo} seq={seq} temp={temp_mC/1000:.1f}C alert={(flags & 0x2) >> 1}"
+                              + (f" dropped={drops} (total {perdidas})" if drops else ""))
+                    elif len(data) == SAMPLE_SIZE:
                         ts_ns, temp_mC, flags = struct.unpack(SAMPLE_STRUCT, data)
                         tiempo = mostrar_tiempo(ts_ns)
                         print(f"{tiempo} temp={temp_mC/1000:.1f}C alert={(flags & 0x2) >> 1}")
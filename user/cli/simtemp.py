@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+# NumPy binding for the nxp_simtemp driver
+# Reads many records per call straight into a preallocated structured array
+# (no per-record struct.unpack) and offers vectorised helpers on top of it.
+#
+#   import simtemp
+#   with simtemp.SimTemp(v2=True) as dev:
+#       rec = dev.read(4096)                       # view into dev's buffer
+#       hot = simtemp.above(rec, 30000)            # records over 30 C
+#       print(simtemp.to_datetime64(hot), simtemp.temps_c(hot))
+
+import fcntl
+import os
+import select
+import struct
+
+# The UAPI constants below are shared with main.py, simtemp_record.py and
+# stress.sh, which do not need NumPy: only SimTemp and the helpers do.
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
+FLAG_NEW_SAMPLE = 1 << 0
+FLAG_THRESHOLD_CROSSED = 1 << 1
+
+# _IOW('s', 4, __u32) and record formats
+SIMTEMP_IOC_SET_RECORD_FORMAT = (1 << 30) | (4 << 16) | (ord('s') << 8) | 4
+SIMTEMP_RECORD_V1 = 1
+SIMTEMP_RECORD_V2 = 2
+
+# Packed little-endian layouts of kernel/nxp_simtemp.h
+if np is not None:
+    SAMPLE_DTYPE = np.dtype([
+        ("timestamp_ns", "<u8"),    # ktime_get_real_ns()
+        ("temp_mC", "<i4"),         # milli-degrees Celsius
+        ("flags", "<u4"),           # bit0 NEW_SAMPLE, bit1 THRESHOLD, bits 8..15 channel
+    ])
+    SAMPLE_V2_DTYPE = np.dtype([
+        ("timestamp_ns", "<u8"),
+        ("temp_mC", "<i4"),
+        ("flags", "<u4"),           # v1 flags, bits 16..31 drops since last record
+        ("seq", "<u8"),             # sequence number of the sample
+    ])
+    assert SAMPLE_DTYPE.itemsize == 16 and SAMPLE_V2_DTYPE.itemsize == 24
+
+DEV_DIR = "/dev"
+CLASS_DIR = "/sys/class/simtemp"
+
+
+def discover():
+    """Sample devices under /sys/class/simtemp (aggregate nodes skipped)."""
+    try:
+        return sorted(n for n in os.listdir(CLASS_DIR) if not n.endswith("_agg"))
+    except FileNotFoundError:
+        return []
+
+
+class SimTemp:
+    """One open sample stream with a reusable record buffer."""
+
+    def __init__(self, name="simtemp0", v2=False, nonblock=False, capacity=4096):
+        if np is None:
+            raise ImportError("simtemp.SimTemp needs NumPy")
+        self.name = name
+        self.dtype = SAMPLE_V2_DTYPE if v2 else SAMPLE_DTYPE
+        self._buf = np.empty(capacity, dtype=self.dtype)
+        flags = os.O_RDONLY | (os.O_NONBLOCK if nonblock else 0)
+        self._file = os.fdopen(os.open(os.path.join(DEV_DIR, name), flags), "rb", buffering=0)
+        if v2:
+            fcntl.ioctl(self._file.fileno(), SIMTEMP_IOC_SET_RECORD_FORMAT,
+                        struct.pack("I", SIMTEMP_RECORD_V2))
+        self._poll = select.poll()
+        self._poll.register(self._file.fileno(), select.POLLIN)
+
+    def fileno(self):
+        return self._file.fileno()
+
+    def close(self):
+        self._file.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def _ready(self):
+        return any(ev & select.POLLIN for _, ev in self._poll.poll(0))
+
+    def read_into(self, out):
+        """
+        Fill the structured array out (dtype self.dtype) and return how many
+        records were read. Waits for the first record unless non-blocking,
+        then takes whatever else is ready.
+        """
+        raw = memoryview(out).cast("B")
+        size = self.dtype.itemsize
+        got = 0
+        while got < len(out):
+            if got and not self._ready():
+                break
+            try:
+                n = self._file.readinto(raw[got * size:])
+            except BlockingIOError:
+                break
+            if not n:
+                break
+            got += n // size
+        return got
+
+    def read(self, count=None):
+        """Read up to count records, returned as a view of the internal buffer."""
+        count = len(self._buf) if count is None else count
+        if count > len(self._buf):
+            self._buf = np.empty(count, dtype=self.dtype)
+        return self._buf[:self.read_into(self._buf[:count])]
+
+    def get(self, attr):
+        with open(os.path.join(CLASS_DIR, self.name, attr)) as f:
+            return f.read().strip()
+
+    def set(self, attr, value):
+        with open(os.path.join(CLASS_DIR, self.name, attr), "w") as f:
+            f.write(str(value))
+
+
+# Vectorised helpers, rec is any array of SAMPLE_DTYPE or SAMPLE_V2_DTYPE
+
+def to_datetime64(rec):
+    """UTC timestamps as datetime64[ns]."""
+    return rec["timestamp_ns"].astype("datetime64[ns]")
+
+
+def temps_c(rec):
+    """Temperatures in degrees Celsius."""
+    return rec["temp_mC"] / 1000.0
+
+
+def channels(rec):
+    return (rec["flags"] >> 8) & 0xff
+
+
+def alerts(rec):
+    """Records the driver flagged as over its threshold."""
+    return rec[(rec["flags"] & FLAG_THRESHOLD_CROSSED) != 0]
+
+
+def above(rec, threshold_mc):
+    """Records over an arbitrary threshold (milli-degrees)."""
+    return rec[rec["temp_mC"] > threshold_mc]
+
+
+def drops(rec):
+    """Samples lost before each v2 record."""
+    return rec["flags"] >> 16
@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+# Capture file format shared by simtemp_record.py and simtemp_replay.py
+#
+# Layout (little-endian), append-only:
+#   header   "SIMTCAP1", u16 format version, u16 record version (1/2),
+#            u16 record size, u16 clock id, u32 length of the JSON config,
+#            JSON config (device name, sysfs snapshot, start time)
+#   blocks   "BLK0", u32 compressed length, u32 records, u64 first ts,
+#            u64 last ts, zlib(raw records exactly as read from the device)
+#   index    "IDX0", u32 entries, entries of (u64 offset, u64 first ts,
+#            u32 records), then u64 offset of "IDX0" and "SIMTEND1"
+#
+# The index is only written on a clean close. Without it (recorder killed)
+# readers rebuild it by walking the block headers, skipping the payloads.
+#
+# Timestamps (records, block and index "first ts") are the driver's
+# wall-clock ktime_get_real_ns(). Seeking with from_ns assumes they grow in
+# file order: after a clock step (settimeofday, NTP) during the recording,
+# blocks() may start at the wrong block. Reading from the start is always
+# correct.
+
+import json
+import os
+import struct
+import zlib
+
+MAGIC = b"SIMTCAP1"
+END_MAGIC = b"SIMTEND1"
+FORMAT_VERSION = 1
+CLOCK_REALTIME = 0      # timestamps are ktime_get_real_ns()
+
+HEADER = struct.Struct("<8sHHHHI")
+BLOCK = struct.Struct("<4sIIQQ")
+INDEX = struct.Struct("<4sI")
+INDEX_ENTRY = struct.Struct("<QQI")
+FOOTER = struct.Struct("<Q8s")
+
+RECORD_SIZES = {1: 16, 2: 24}
+RECORD_TS = struct.Struct("<Q")     # timestamp_ns leads both record versions
+
+
+class CaptureWriter:
+    def __init__(self, path, record_version, config, level=6):
+        self.record_size = RECORD_SIZES[record_version]
+        self.level = level
+        self.index = []
+        self.f = open(path, "wb")
+        meta = json.dumps(config, sort_keys=True).encode()
+        self.f.write(HEADER.pack(MAGIC, FORMAT_VERSION, record_version, self.record_size,
+                                 CLOCK_REALTIME, len(meta)))
+        self.f.write(meta)
+
+    def write_block(self, raw):
+        """Compress and append whole records (bytes-like, record_size multiple)."""
+        count = len(raw) // self.record_size
+        if not count:
+            return
+        first = RECORD_TS.unpack_from(raw, 0)[0]
+        last = RECORD_TS.unpack_from(raw, (count - 1) * self.record_size)[0]
+        data = zlib.compress(bytes(raw[:count * self.record_size]), self.level)
+        self.index.append((self.f.tell(), first, count))
+        self.f.write(BLOCK.pack(b"BLK0", len(data), count, first, last))
+        self.f.write(data)
+        self.f.flush()
+
+    def close(self):
+        offset = self.f.tell()
+        self.f.write(INDEX.pack(b"IDX0", len(self.index)))
+        for entry in self.index:
+            self.f.write(INDEX_ENTRY.pack(*entry))
+        self.f.write(FOOTER.pack(offset, END_MAGIC))
+        self.f.close()
+
+
+class CaptureReader:
+    def __init__(self, path):
+        self.f = open(path, "rb")
+        magic, version, self.record_version, self.record_size, self.clock, meta_len = \
+            HEADER.unpack(self.f.read(HEADER.size))
+        if magic != MAGIC or version != FORMAT_VERSION:
+            raise ValueError(f"{path}: not a simtemp capture")
+        self.config = json.loads(self.f.read(meta_len))
+        self.data_start = self.f.tell()
+        self.index = self._read_index() or self._scan_index()
+
+    def _read_index(self):
+        size = self.f.seek(0, os.SEEK_END)
+        if size < self.data_start + FOOTER.size:
+            return None
+        self.f.seek(size - FOOTER.size)
+        offset, magic = FOOTER.unpack(self.f.read(FOOTER.size))
+        if magic != END_MAGIC:
+            return None
+        self.f.seek(offset)
+        tag, entries = INDEX.unpack(self.f.read(INDEX.size))
+        if tag != b"IDX0":
+            return None
+        return [INDEX_ENTRY.unpack(self.f.read(INDEX_ENTRY.size)) for _ in range(entries)]
+
+    def _scan_index(self):
+        index = []
+        size = self.f.seek(0, os.SEEK_END)
+        offset = self.data_start
+        self.f.seek(offset)
+        while True:
+            hdr = self.f.read(BLOCK.size)
+            if len(hdr) < BLOCK.size:
+                break
+            tag, length, count, first, _ = BLOCK.unpack(hdr)
+            # A block cut short by a killed recorder ends the capture
+            if tag != b"BLK0" or offset + BLOCK.size + length > size:
+                break
+            index.append((offset, first, count))
+            offset = self.f.seek(length, os.SEEK_CUR)
+        return index
+
+    def records(self):
+        return sum(entry[2] for entry in self.index)
+
+    def blocks(self, from_ns=0):
+        """Raw record bytes of every block, starting at the block holding from_ns."""
+        start = 0
+        for i, (_, first, _) in enumerate(self.index):
+            if first <= from_ns:
+                start = i
+        for offset, _, _ in self.index[start:]:
+            self.f.seek(offset)
+            tag, length, count, _, _ = BLOCK.unpack(self.f.read(BLOCK.size))
+            raw = zlib.decompress(self.f.read(length))
+            if len(raw) != count * self.record_size:
+                raise ValueError(f"corrupt block at offset {offset}")
+            yield raw
+
+    def close(self):
+        self.f.close()
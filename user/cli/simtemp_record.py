@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+# simtemp-record: write the raw /dev/simtemp0 stream to a capture file
+# (format in simtemp_capture.py). Records are stored exactly as read and
+# compressed per block; CTRL+C or SIGTERM closes the file with its index.
+
+import argparse
+import fcntl
+import os
+import select
+import signal
+import struct
+import time
+
+import simtemp_capture as cap
+from simtemp import SIMTEMP_IOC_SET_RECORD_FORMAT, SIMTEMP_RECORD_V1, SIMTEMP_RECORD_V2
+
+DEV_DIR = "/dev"
+CLASS_DIR = "/sys/class/simtemp"
+
+# sysfs attributes saved in the header
+CONFIG_ATTRS = ("sampling_ms", "sampling_us", "threshold_mc", "mode", "noise_mc",
+                "noise_dist", "seed", "producer", "stats")
+
+
+def snapshot(name):
+    config = {}
+    for attr in CONFIG_ATTRS:
+        try:
+            with open(os.path.join(CLASS_DIR, name, attr)) as f:
+                config[attr] = f.read().strip()
+        except OSError:
+            pass
+    return config
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Record the nxp_simtemp stream to a capture file")
+    parser.add_argument("output", help="Capture file to write")
+    parser.add_argument("--device", default="simtemp0", help="Device name")
+    parser.add_argument("--v2", action="store_true", help="Record v2 records (sequence number, drops)")
+    parser.add_argument("--block", type=int, default=4096, help="Records per compressed block")
+    parser.add_argument("--flush", type=float, default=5.0, help="Write a block at least every N seconds")
+    parser.add_argument("--count", type=int, default=0, help="Stop after N records (0 = until signal)")
+    args = parser.parse_args()
+
+    version = SIMTEMP_RECORD_V2 if args.v2 else SIMTEMP_RECORD_V1
+    rec_size = cap.RECORD_SIZES[version]
+    fd = os.open(os.path.join(DEV_DIR, args.device), os.O_RDONLY | os.O_NONBLOCK)
+    if args.v2:
+        fcntl.ioctl(fd, SIMTEMP_IOC_SET_RECORD_FORMAT, struct.pack("I", version))
+
+    config = {"device": args.device, "start_unix_ns": time.time_ns(), "sysfs": snapshot(args.device)}
+    writer = cap.CaptureWriter(args.output, version, config)
+
+    stop = False
+
+    def on_signal(*_):
+        nonlocal stop
+        stop = True
+    signal.signal(signal.SIGINT, on_signal)
+    signal.signal(signal.SIGTERM, on_signal)
+
+    buf = bytearray(args.block * rec_size)
+    view = memoryview(buf)
+    fill = total = 0
+    last_flush = time.monotonic()
+    poller = select.poll()
+    poller.register(fd, select.POLLIN)
+
+    while not stop and not (args.count and total >= args.count):
+        if poller.poll(200):
+            end = len(buf)
+            if args.count:
+                # Never read past the N records asked for
+                end = min(end, fill + (args.count - total) * rec_size)
+            try:
+                n = os.readv(fd, [view[fill:end]])
+            except BlockingIOError:
+                n = 0
+            fill += n - n % rec_size
+            total += n // rec_size
+        if fill == len(buf) or (fill and time.monotonic() - last_flush >= args.flush):
+            writer.write_block(view[:fill])
+            fill = 0
+            last_flush = time.monotonic()
+
+    writer.write_block(view[:fill])
+    writer.close()
+    os.close(fd)
+    print(f"{total} records ({len(writer.index)} blocks) written to {args.output}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+# simtemp-replay: feed a capture file (see simtemp_capture.py) to consumers
+# like /dev/simtemp0 would: one whole record per write, paced by the
+# recorded timestamps (scaled by --speed), so readers blocking in read() or
+# waiting in poll() for POLLIN behave as on the device. Output goes to
+# stdout, a named pipe (--fifo) or a new pseudo terminal (--pty).
+
+import argparse
+import os
+import pty
+import struct
+import sys
+import time
+import tty
+
+import simtemp_capture as cap
+
+
+def info(reader):
+    print(f"record version {reader.record_version} ({reader.record_size} bytes), clock id {reader.clock}")
+    print(f"{reader.records()} records in {len(reader.index)} blocks")
+    for key, value in sorted(reader.config.items()):
+        print(f"{key}: {value}")
+
+
+def open_output(args):
+    if args.pty:
+        master, slave = pty.openpty()
+        tty.setraw(slave)   # records are binary, no line discipline
+        print(f"Replaying on {os.ttyname(slave)}", file=sys.stderr)
+        return master
+    if args.fifo:
+        if not os.path.exists(args.fifo):
+            os.mkfifo(args.fifo)
+        print(f"Waiting for a reader on {args.fifo}", file=sys.stderr)
+        return os.open(args.fifo, os.O_WRONLY)
+    return sys.stdout.fileno()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Replay a simtemp capture file")
+    parser.add_argument("capture", help="Capture file written by simtemp_record.py")
+    parser.add_argument("--speed", type=float, default=1.0, help="Time scale (2 = twice as fast, 0 = no pacing)")
+    parser.add_argument("--from-ns", type=int, default=0, help="Start at this timestamp")
+    parser.add_argument("--loop", action="store_true", help="Start over at the end of the capture")
+    output = parser.add_mutually_exclusive_group()
+    output.add_argument("--fifo", help="Named pipe to write to (created if missing)")
+    output.add_argument("--pty", action="store_true", help="Write to a new pseudo terminal")
+    parser.add_argument("--info", action="store_true", help="Print the header and index, then exit")
+    args = parser.parse_args()
+
+    reader = cap.CaptureReader(args.capture)
+    if args.info:
+        info(reader)
+        return
+
+    fd = open_output(args)
+    size = reader.record_size
+    ts_of = struct.Struct("<Q").unpack_from
+
+    try:
+        while True:
+            start_ts = None
+            for raw in reader.blocks(args.from_ns):
+                for off in range(0, len(raw), size):
+                    ts = ts_of(raw, off)[0]
+                    if ts < args.from_ns:
+                        continue
+                    if args.speed > 0:
+                        if start_ts is None:
+                            start_ts, start = ts, time.monotonic()
+                        delay = start + (ts - start_ts) / 1e9 / args.speed - time.monotonic()
+                        if delay > 0:
+                            time.sleep(delay)
+                    os.write(fd, raw[off:off + size])
+            if not args.loop:
+                break
+    except (BrokenPipeError, KeyboardInterrupt):
+        pass
+    finally:
+        reader.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,309 @@
+/*
+ * user/lib/simtemp.c
+ * libsimtemp: userspace client library of the nxp_simtemp driver.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "simtemp.h"
+
+/* Aggregate streams (simtemp0_agg) are children of the sample device */
+static int simtemp_is_sample_dev(const char *name)
+{
+	size_t len = strlen(name);
+
+	if (name[0] == '.')
+		return 0;
+	return !(len > 4 && strcmp(name + len - 4, "_agg") == 0);
+}
+
+int simtemp_discover(char names[][SIMTEMP_NAME_MAX], int max)
+{
+	struct dirent *de;
+	DIR *dir;
+	int count = 0;
+
+	dir = opendir(SIMTEMP_CLASS_PATH);
+	if (!dir)
+		return -errno;
+
+	while ((de = readdir(dir)) != NULL) {
+		if (!simtemp_is_sample_dev(de->d_name) || strlen(de->d_name) >= SIMTEMP_NAME_MAX)
+			continue;
+		if (count < max)
+			strcpy(names[count], de->d_name);
+		count++;
+	}
+
+	closedir(dir);
+	return count;
+}
+
+int simtemp_open(struct simtemp_handle *h, const char *name, unsigned int flags)
+{
+	char path[PATH_MAX];
+	__u32 format = SIMTEMP_RECORD_V2;
+
+	if (strlen(name) >= SIMTEMP_NAME_MAX)
+		return -ENAMETOOLONG;
+
+	snprintf(path, sizeof(path), SIMTEMP_DEV_PATH "/%s", name);
+	h->fd = open(path, O_RDONLY | O_CLOEXEC | ((flags & SIMTEMP_OPEN_NONBLOCK) ? O_NONBLOCK : 0));
+	if (h->fd < 0)
+		return -errno;
+
+	h->flags = flags;
+	h->record_size = sizeof(struct simtemp_sample);
+	strcpy(h->name, name);
+
+	if (flags & SIMTEMP_OPEN_V2) {
+		if (ioctl(h->fd, SIMTEMP_IOC_SET_RECORD_FORMAT, &format) < 0) {
+			int err = -errno;
+
+			close(h->fd);
+			h->fd = -1;
+			return err;
+		}
+		h->record_size = sizeof(struct simtemp_sample_v2);
+	}
+
+	return 0;
+}
+
+void simtemp_close(struct simtemp_handle *h)
+{
+	if (h->fd >= 0)
+		close(h->fd);
+	h->fd = -1;
+}
+
+/*
+ * SYSFS
+ */
+
+static int simtemp_attr_path(const struct simtemp_handle *h, const char *attr, char *path, size_t len)
+{
+	if (snprintf(path, len, SIMTEMP_CLASS_PATH "/%s/%s", h->name, attr) >= (int)len)
+		return -ENAMETOOLONG;
+	return 0;
+}
+
+int simtemp_get_attr(const struct simtemp_handle *h, const char *attr, char *buf, size_t len)
+{
+	char path[PATH_MAX];
+	ssize_t n;
+	int fd, ret;
+
+	if (!len)
+		return -EINVAL;
+	ret = simtemp_attr_path(h, attr, path, sizeof(path));
+	if (ret)
+		return ret;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	n = read(fd, buf, len - 1);
+	ret = n < 0 ? -errno : 0;
+	close(fd);
+	if (ret)
+		return ret;
+
+	// Drop the trailing newline of the attribute
+	while (n > 0 && buf[n - 1] == '\n')
+		n--;
+	buf[n] = '\0';
+
+	return 0;
+}
+
+int simtemp_set_attr(const struct simtemp_handle *h, const char *attr, const char *value)
+{
+	char path[PATH_MAX];
+	size_t len = strlen(value);
+	ssize_t n;
+	int fd, ret;
+
+	ret = simtemp_attr_path(h, attr, path, sizeof(path));
+	if (ret)
+		return ret;
+
+	fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	n = write(fd, value, len);
+	ret = n < 0 ? -errno : ((size_t)n != len ? -EIO : 0);
+	close(fd);
+
+	return ret;
+}
+
+int simtemp_get_int(const struct simtemp_handle *h, const char *attr, long *value)
+{
+	char buf[32], *end;
+	int ret;
+
+	ret = simtemp_get_attr(h, attr, buf, sizeof(buf));
+	if (ret)
+		return ret;
+
+	errno = 0;
+	*value = strtol(buf, &end, 0);
+	if (errno || end == buf)
+		return -EINVAL;
+
+	return 0;
+}
+
+int simtemp_set_int(const struct simtemp_handle *h, const char *attr, long value)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%ld", value);
+	return simtemp_set_attr(h, attr, buf);
+}
+
+/*
+ * IOCTLS
+ */
+
+int simtemp_set_channel_mask(struct simtemp_handle *h, __u64 mask)
+{
+	return ioctl(h->fd, SIMTEMP_IOC_SET_CHANNEL_MASK, &mask) < 0 ? -errno : 0;
+}
+
+int simtemp_set_alert_eventfd(struct simtemp_handle *h, int eventfd)
+{
+	__s32 fd = eventfd;
+
+	return ioctl(h->fd, SIMTEMP_IOC_SET_ALERT_EVENTFD, &fd) < 0 ? -errno : 0;
+}
+
+int simtemp_latest(struct simtemp_handle *h, unsigned int channel, struct simtemp_sample_v2 *rec)
+{
+	struct simtemp_latest latest = { .channel = channel };
+
+	if (ioctl(h->fd, SIMTEMP_IOC_GET_LATEST, &latest) < 0)
+		return -errno;
+	*rec = latest.sample;
+
+	return 0;
+}
+
+ssize_t simtemp_history(struct simtemp_handle *h, __u64 from_ns, __u64 to_ns,
+			struct simtemp_sample *buf, size_t max, __u64 *oldest_ns)
+{
+	struct simtemp_history_query query = {
+		.from_ns = from_ns,
+		.to_ns = to_ns,
+		.records = (__u64)(unsigned long)buf,
+		.max_records = max > UINT_MAX ? UINT_MAX : (__u32)max,
+	};
+
+	if (ioctl(h->fd, SIMTEMP_IOC_HISTORY, &query) < 0)
+		return -errno;
+	if (oldest_ns)
+		*oldest_ns = query.oldest_ns;
+
+	return query.count;
+}
+
+/*
+ * READ
+ */
+
+/* Nothing left to read without blocking? */
+static int simtemp_drained(int fd)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+	return poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLIN);
+}
+
+ssize_t simtemp_read(struct simtemp_handle *h, void *buf, size_t max)
+{
+	char *out = buf;
+	size_t got = 0;
+	ssize_t n;
+
+	// A read may return several records, the first one waits as configured
+	// and the rest are only taken while poll() says they are ready
+	while (got < max) {
+		if (got && simtemp_drained(h->fd))
+			break;
+		n = read(h->fd, out + got * h->record_size, (max - got) * h->record_size);
+		if (n < 0) {
+			if (errno == EINTR && !got)
+				continue;
+			if (got)
+				break;
+			return -errno;
+		}
+		if (n == 0)
+			break;
+		got += n / h->record_size;
+	}
+
+	return got;
+}
+
+/*
+ * EVENT LOOP
+ */
+
+int simtemp_fd(const struct simtemp_handle *h)
+{
+	return h->fd;
+}
+
+short simtemp_poll_events(void)
+{
+	return POLLIN | POLLPRI;
+}
+
+int simtemp_dispatch(struct simtemp_handle *h, short revents, void *buf, size_t max,
+		     const struct simtemp_events *ev, void *ctx)
+{
+	ssize_t n;
+
+	if (revents & POLLNVAL)
+		return -EIO;
+
+	// POLLERR only reports lost samples, the next read clears it
+	if ((revents & POLLERR) && ev->overrun)
+		ev->overrun(ctx);
+
+	if ((revents & POLLPRI) && ev->alert)
+		ev->alert(ctx);
+
+	if (revents & POLLIN) {
+		n = simtemp_read(h, buf, max);
+		if (n < 0 && n != -EAGAIN)
+			return n;
+		if (n > 0 && ev->samples)
+			ev->samples(ctx, buf, n);
+	}
+
+	return 0;
+}
+
+int simtemp_wait(struct simtemp_handle *h, int timeout_ms)
+{
+	struct pollfd pfd = { .fd = h->fd, .events = simtemp_poll_events() };
+	int ret;
+
+	ret = poll(&pfd, 1, timeout_ms);
+	if (ret < 0)
+		return -errno;
+
+	return ret ? pfd.revents : 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * user/lib/simtemp.h
+ * libsimtemp: userspace client library of the nxp_simtemp driver.
+ *
+ * Record layouts and ioctls come from the driver's UAPI header
+ * (kernel/nxp_simtemp.h). Functions return 0 (or a count) on success and
+ * -errno on failure. The read path never allocates: records go straight
+ * into buffers provided by the caller, and handles can live on the stack.
+ */
+
+#ifndef _SIMTEMP_H
+#define _SIMTEMP_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "nxp_simtemp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SIMTEMP_CLASS_PATH "/sys/class/simtemp"
+#define SIMTEMP_DEV_PATH   "/dev"
+#define SIMTEMP_NAME_MAX   32
+
+/* simtemp_open() flags */
+#define SIMTEMP_OPEN_NONBLOCK (1U << 0)	// reads return -EAGAIN instead of blocking
+#define SIMTEMP_OPEN_V2       (1U << 1)	// read struct simtemp_sample_v2 records
+
+/* An open sample stream, caller allocated */
+struct simtemp_handle {
+	int fd;
+	unsigned int flags;
+	size_t record_size;					// sizeof the record format in use
+	char name[SIMTEMP_NAME_MAX];		// e.g. "simtemp0"
+};
+
+/* Callbacks of simtemp_dispatch(), any may be NULL */
+struct simtemp_events {
+	void (*samples)(void *ctx, const void *records, size_t count);
+	void (*alert)(void *ctx);
+	void (*overrun)(void *ctx);			// samples were lost since the last read (POLLERR)
+};
+
+/*
+ * Sample devices under /sys/class/simtemp (aggregate nodes skipped), in
+ * directory order. Returns how many exist; at most max names are stored.
+ */
+int simtemp_discover(char names[][SIMTEMP_NAME_MAX], int max);
+
+int simtemp_open(struct simtemp_handle *h, const char *name, unsigned int flags);
+void simtemp_close(struct simtemp_handle *h);
+
+/* sysfs attributes of the device (sampling_ms, threshold_mc, mode, ...) */
+int simtemp_get_attr(const struct simtemp_handle *h, const char *attr, char *buf, size_t len);
+int simtemp_set_attr(const struct simtemp_handle *h, const char *attr, const char *value);
+int simtemp_get_int(const struct simtemp_handle *h, const char *attr, long *value);
+int simtemp_set_int(const struct simtemp_handle *h, const char *attr, long value);
+
+/* Per open file settings (a mask with none of the device's channels fails with EINVAL) */
+int simtemp_set_channel_mask(struct simtemp_handle *h, __u64 mask);
+
+/* Have the driver signal eventfd (from eventfd(2)) once per alert, -1 unbinds */
+int simtemp_set_alert_eventfd(struct simtemp_handle *h, int eventfd);
+
+/*
+ * Read up to max records (struct simtemp_sample, or struct simtemp_sample_v2
+ * with SIMTEMP_OPEN_V2) into buf. Blocks for the first record unless the
+ * handle is non-blocking, then takes whatever else is ready without
+ * blocking. Returns the number of records read.
+ */
+ssize_t simtemp_read(struct simtemp_handle *h, void *buf, size_t max);
+
+/* Newest record of a channel, read without consuming the stream */
+int simtemp_latest(struct simtemp_handle *h, unsigned int channel, struct simtemp_sample_v2 *rec);
+
+/* Records of [from_ns, to_ns] kept by the in-kernel history (to_ns 0 = newest) */
+ssize_t simtemp_history(struct simtemp_handle *h, __u64 from_ns, __u64 to_ns,
+			struct simtemp_sample *buf, size_t max, __u64 *oldest_ns);
+
+/*
+ * Event loop integration: watch simtemp_fd() for simtemp_poll_events() in
+ * poll/epoll/libuv/..., then hand the returned events to simtemp_dispatch(),
+ * which reads up to max records into buf and calls the callbacks.
+ */
+int simtemp_fd(const struct simtemp_handle *h);
+short simtemp_poll_events(void);
+int simtemp_dispatch(struct simtemp_handle *h, short revents, void *buf, size_t max,
+		     const struct simtemp_events *ev, void *ctx);
+
+/* poll() on the handle alone. Returns the revents, 0 on timeout */
+int simtemp_wait(struct simtemp_handle *h, int timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SIMTEMP_H */
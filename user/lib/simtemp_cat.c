@@ -0,0 +1,79 @@
+/*
+ * user/lib/simtemp_cat.c
+ * Example client of libsimtemp: prints the v2 records of a device and
+ * reports alerts and lost samples, driven by a poll() loop.
+ *
+ * Usage: simtemp_cat [device]   (default: first device found)
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "simtemp.h"
+
+#define BATCH 64
+
+static void on_samples(void *ctx, const void *records, size_t count)
+{
+	const struct simtemp_sample_v2 *rec = records;
+	unsigned long long *lost = ctx;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		*lost += SIMTEMP_FLAG_DROPS(rec[i].flags);
+		printf("%llu seq=%llu ch=%u temp=%.3fC alert=%u lost=%llu\n",
+		       (unsigned long long)rec[i].timestamp_ns, (unsigned long long)rec[i].seq,
+		       SIMTEMP_FLAG_CHANNEL(rec[i].flags), rec[i].temp_mC / 1000.0,
+		       !!(rec[i].flags & SIMTEMP_FLAG_THRESHOLD_CROSSED), *lost);
+	}
+}
+
+static void on_alert(void *ctx)
+{
+	(void)ctx;
+	printf(">>> ALERT: Threshold exceeded <<<\n");
+}
+
+int main(int argc, char **argv)
+{
+	static const struct simtemp_events events = { .samples = on_samples, .alert = on_alert };
+	struct simtemp_sample_v2 buf[BATCH];
+	char names[8][SIMTEMP_NAME_MAX];
+	struct simtemp_handle h;
+	unsigned long long lost = 0;
+	struct pollfd pfd;
+	int ret;
+
+	if (argc > 1) {
+		snprintf(names[0], sizeof(names[0]), "%s", argv[1]);
+	} else {
+		ret = simtemp_discover(names, 8);
+		if (ret <= 0) {
+			fprintf(stderr, "simtemp_cat: no device found (%s)\n", ret ? strerror(-ret) : "empty");
+			return 1;
+		}
+	}
+
+	ret = simtemp_open(&h, names[0], SIMTEMP_OPEN_NONBLOCK | SIMTEMP_OPEN_V2);
+	if (ret) {
+		fprintf(stderr, "simtemp_cat: %s: %s\n", names[0], strerror(-ret));
+		return 1;
+	}
+
+	pfd.fd = simtemp_fd(&h);
+	pfd.events = simtemp_poll_events();
+	for (;;) {
+		if (poll(&pfd, 1, -1) < 0)
+			break;
+		ret = simtemp_dispatch(&h, pfd.revents, buf, BATCH, &events, &lost);
+		if (ret) {
+			fprintf(stderr, "simtemp_cat: %s\n", strerror(-ret));
+			break;
+		}
+		fflush(stdout);
+	}
+
+	simtemp_close(&h);
+	return 0;
+}